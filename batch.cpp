@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "batch.hpp"
+#include "convert.hpp"
+#include "parallel.hpp"
+
+static bool read_all(FILE *file, std::vector<char> &data) {
+  char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+    data.insert(data.end(), buf, buf + n);
+  return !ferror(file);
+}
+
+// Reads the project mapped in `desc` from path + ".ptcache" if that was saved
+// from the same bytes, or else from `desc`, saving the cache for next time.
+// Failing to save the cache isn't an error.
+static pxtnERR read_cached(pxtnService &pxtn, const std::string &path,
+                           pxtnDescriptor &desc, pxtnDescriptor &cache_desc) {
+  int32_t size = 0;
+  const uint8_t *p = desc.get_p_cur(&size);
+  uint64_t hash = pxtnService_cache_Hash(p, size);
+
+  std::string cache_path = path + ".ptcache";
+  if (FILE *file = fopen(cache_path.c_str(), "rb")) {
+    bool mapped = cache_desc.set_file_map_r(file);
+    fclose(file);
+    if (mapped && pxtn.read_cache(&cache_desc, hash) == pxtnOK) return pxtnOK;
+  }
+
+  pxtnERR res = pxtn.read_lazy(&desc);
+  if (res != pxtnOK) return res;
+
+  // Written aside and renamed over, so readers never see half a cache.
+  std::string tmp_path = cache_path + ".tmp";
+  if (FILE *file = fopen(tmp_path.c_str(), "wb")) {
+    bool ok;
+    {
+      // Gone before fclose, since it flushes on the way out.
+      pxtnDescriptor out;
+      ok = out.set_file_w(file) && pxtn.write_cache(&out, hash) == pxtnOK;
+    }
+    if (fclose(file) != 0) ok = false;
+    if (!ok || rename(tmp_path.c_str(), cache_path.c_str()) != 0)
+      remove(tmp_path.c_str());
+  }
+  return pxtnOK;
+}
+
+static bool convert_file(pxtnService &pxtn, const std::string &path,
+                         const ConvertOptions &options, BatchResult &result) {
+  std::string &error = result.error;
+  bool std_io = (path == "-"); // read stdin, write stdout
+
+  // Conversion only needs the woices' names, so their payloads are skipped
+  // (read_lazy) and never loaded; desc may go once the project is read.
+  pxtnDescriptor desc, cache_desc;
+  pxtnERR res = pxtnERR_desc_r;
+  std::vector<char> input;
+  if (std_io) {
+    // Reading is a single pass, but pxtone still seeks around within chunks,
+    // so a pipe is read into memory first.
+    if (read_all(stdin, input) && desc.set_memory_r(input.data(), input.size()))
+      res = pxtn.read_lazy(&desc);
+  } else {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+      error = "could not open file";
+      return false;
+    }
+    // Read straight from the mapped file where possible, and through stdio
+    // for anything that can't be mapped.
+    if (desc.set_file_map_r(file)) {
+      res = options.cache ? read_cached(pxtn, path, desc, cache_desc)
+                          : pxtn.read_lazy(&desc);
+    } else if (desc.set_file_r(file)) {
+      res = pxtn.read_lazy(&desc);
+    }
+    fclose(file);
+  }
+  if (res != pxtnOK) {
+    error = pxtnError_get_string(res);
+    return false;
+  }
+
+  std::string out_path = (std_io ? "stdout" : path + ".mid");
+  FILE *out = (std_io ? stdout : fopen(out_path.c_str(), "wb"));
+  if (!out) {
+    error = "could not open " + out_path;
+    return false;
+  }
+  FileSink sink(out);
+  bool written = pxtn_to_smf(pxtn, sink, options, &result.stats);
+  if ((std_io ? fflush(out) : fclose(out)) != 0) written = false;
+  if (!written) {
+    error = "could not write " + out_path;
+    return false;
+  }
+  return true;
+}
+
+std::vector<BatchResult> convert_batch(const std::vector<std::string> &paths,
+                                       const ConvertOptions &options) {
+  std::vector<BatchResult> results(paths.size());
+  // With several files the pool already keeps every core busy, so units are
+  // only converted in parallel when there's a single file.
+  ConvertOptions file_options = options;
+  if (paths.size() > 1) file_options.threads = 1;
+  parallel_for(paths.size(), options.threads, [&]() {
+    // shared_ptr so the worker lambda stays copyable; pxtnService isn't.
+    auto pxtn = std::make_shared<pxtnService>();
+    pxtnERR init_res = pxtn->init();
+    return [&, pxtn, init_res](int i) {
+      BatchResult &result = results[i];
+      result.path = paths[i];
+      if (init_res != pxtnOK) {
+        result.ok = false;
+        result.error = pxtnError_get_string(init_res);
+      } else {
+        result.ok = convert_file(*pxtn, paths[i], file_options, result);
+      }
+    };
+  });
+  return results;
+}
@@ -0,0 +1,23 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <string>
+#include <vector>
+
+#include "convert.hpp"
+
+struct BatchResult {
+  std::string path;
+  bool ok;
+  std::string error;
+  ConvertStats stats;
+};
+
+// Converts each file to <file>.mid on a pool of options.threads workers (0
+// means one per core). A path of "-" converts stdin to stdout. Each worker
+// keeps a single pxtnService around for all the files it converts. Results are
+// in the same order as `paths`.
+std::vector<BatchResult> convert_batch(const std::vector<std::string> &paths,
+                                       const ConvertOptions &options);
+
+#endif // BATCH_HPP
@@ -1,73 +1,116 @@
-#include <cctype>
-#include <cmath>
 #include <algorithm>
 
-#include "historical.hpp"
-#include "pitch_bend.hpp"
-#include "pttypes.hpp"
 #include "convert.hpp"
+#include "parallel.hpp"
+#include "pttypes.hpp"
+#include "track.hpp"
+
+namespace {
+// The pieces of a project that every unit's track is built from.
+struct Converter {
+  Converter(const pxtnService &pxtn, const ConvertOptions &options)
+      : pxtn(pxtn), options(options), woices(Woice::get_woices(pxtn)),
+        units(Unit::get_units(pxtn)) {
+    for (int i = 0; i < (int)units.size(); ++i)
+      ++channel_units[channel(i) & 0x0f];
+  }
 
-MidiFile pxtn_to_midi(const pxtnService &pxtn) {
+  static int channel(int i) {
+    return i >= 9 ? i + 1 : i; // skip the drum channel
+  }
+
+  TrackBuffer track(int i) const {
+    const pxtnUnit &unit = *pxtn.Unit_Get(i);
+    TrackBuffer track = unit_track(units[i], unit.get_name_buf(nullptr),
+                                   channel(i), woices, options.bend_tolerance);
+    // Past the 15th unit, channels wrap around onto earlier units'. Tracks
+    // only meet when they're written, so a track can't know the state of a
+    // channel it shares, and isn't deduplicated.
+    if (channel_units[channel(i) & 0x0f] == 1)
+      track.events_dropped = drop_redundant_events(track);
+    return track;
+  }
+
+  const char *song_name() const {
+    const char *name = pxtn.text->get_name_buf(nullptr);
+    return name ? name : "";
+  }
+
+  const pxtnService &pxtn;
+  const ConvertOptions &options;
   // Get woice and units MIDI correspondence
-  std::vector<Woice> woices = Woice::get_woices(pxtn);
-  std::vector<Unit> units = Unit::get_units(pxtn);
+  std::vector<Woice> woices;
+  std::vector<Unit> units;
+  int channel_units[16] = {0}; // how many units play on each channel
+};
+
+void add_stats(const TrackBuffer &track, ConvertStats *stats) {
+  if (!stats) return;
+  stats->bend_points_removed += track.bend_points_removed;
+  stats->events_dropped += track.events_dropped;
+}
+} // namespace
+
+MidiFile pxtn_to_midi(const pxtnService &pxtn, const ConvertOptions &options,
+                      ConvertStats *stats) {
+  Converter converter(pxtn, options);
 
   MidiFile midifile;
   midifile.addTracks(pxtn.Unit_Num());
   midifile.setTicksPerQuarterNote(480);
 
   // Set track 0 metadata
-  const char *song_name = pxtn.text->get_name_buf(nullptr);
-  if (!song_name) song_name = "";
-  midifile.addTrackName(0, 0, song_name);
+  midifile.addTrackName(0, 0, converter.song_name());
   midifile.addTempo(0, 0, pxtn.master->get_beat_tempo());
   midifile.addTimeSignature(0, 0, pxtn.master->get_beat_num(), 4);
 
-  for (int i = 0; i < pxtn.Unit_Num(); ++i) {
-    int track = i + 1;
-    int channel = (i >= 9 ? i + 1 : i); // skip the drum channel
-
-    const pxtnUnit &unit = *pxtn.Unit_Get(i);
-    midifile.addTrackName(track, 0, unit.get_name_buf(nullptr));
-    // mark cc6 as setting pitch bend range using cc100 and cc101
-    midifile.addController(track, 0, channel, 100, 0);
-    midifile.addController(track, 0, channel, 101, 0);
-
-    // All these pxtone parameters go from 0 to *128*, so we need to cap at 127
-    for (const auto & [ time, volume ] : units[i].volume)
-      midifile.addController(track, time, channel, 11, std::min<int>(volume, 127));
-
-    for (const auto & [ time, pan_v ] : units[i].pan_v)
-      midifile.addController(track, time, channel, 10, std::min<int>(pan_v, 127));
+  // Units don't affect each other, so each gets its own buffer and task; the
+  // buffers are then added to the file in unit order to keep output stable.
+  std::vector<TrackBuffer> tracks(converter.units.size());
+  parallel_for(tracks.size(), options.threads, [&]() {
+    return [&](int i) { tracks[i] = converter.track(i); };
+  });
+  for (int i = 0; i < (int)tracks.size(); ++i) {
+    add_track(midifile, i + 1, tracks[i]);
+    add_stats(tracks[i], stats);
+  }
 
-    // note to self: when doing pan_t, also cap at 127
+  return midifile;
+}
 
-    for (const auto & [ time, voice ] : units[i].voice) {
-      const Woice &woice = woices[voice];
-      if (!woice.drum) midifile.addPatchChange(track, time, channel, woice.num);
-    }
+bool pxtn_to_smf(const pxtnService &pxtn, SmfSink &sink,
+                 const ConvertOptions &options, ConvertStats *stats) {
+  Converter converter(pxtn, options);
+  int num_tracks = converter.units.size();
 
-    for (const auto & [ time, press ] : units[i].presses) {
-      const Woice &woice = woices[units[i].voice.at_time(time)];
-      int real_channel = (woice.drum ? 9 : channel);
-      int key = (woice.drum ? woice.num : units[i].notes.at_time(time));
-      midifile.addNoteOn(track, time, real_channel, key,
-                         std::min<int>(press.vel, 127));
-      midifile.addNoteOff(track, time + press.length, real_channel, key);
-    }
+  SmfWriter smf(sink);
+  smf.header(1, num_tracks + 1, 480);
 
-    Historical<double> pitch_offsets =
-        porta_pitch_offsets(units[i].presses, units[i].notes, units[i].portas);
-    add_pitch_offset(pitch_offsets, units[i].tunings);
+  // Set track 0 metadata
+  int tempo = int(60000000 / pxtn.master->get_beat_tempo() + 0.5);
+  const char tempo_data[] = {char(tempo >> 16), char(tempo >> 8), char(tempo)};
+  const char time_signature[] = {char(pxtn.master->get_beat_num()), 2, 24, 8};
+  smf.begin_track();
+  smf.meta(0, 0x03, converter.song_name());
+  smf.meta(0, 0x51, std::string(tempo_data, sizeof(tempo_data)));
+  smf.meta(0, 0x58, std::string(time_signature, sizeof(time_signature)));
+  smf.end_track();
 
-    for (const auto & [ time, offset ] : pitch_offsets) {
-      int pitch_bend_range = int((std::floor(std::abs(offset) / 4) + 1) * 4);
-      double abs_offset = offset / pitch_bend_range;
-      midifile.addController(track, time, channel, 6, pitch_bend_range);
-      midifile.addPitchBend(track, time, channel, abs_offset);
+  // Tracks are built a window at a time, one per worker, and written out as
+  // soon as their window is done, so at most a window of tracks is in memory.
+  int window = (options.threads > 0 ? options.threads : default_thread_count());
+  std::vector<TrackBuffer> tracks(std::min(window, num_tracks));
+  for (int first = 0; first < num_tracks; first += window) {
+    int count = std::min(window, num_tracks - first);
+    parallel_for(count, options.threads, [&]() {
+      return [&](int i) { tracks[i] = converter.track(first + i); };
+    });
+    for (int i = 0; i < count; ++i) {
+      write_track(smf, tracks[i]);
+      add_stats(tracks[i], stats);
+      tracks[i] = TrackBuffer();
     }
   }
 
-  midifile.sortTracks();
-  return midifile;
+  return smf.good();
 }
@@ -3,8 +3,34 @@
 
 #include "MidiFile.h"
 #include "pxtone/pxtnService.h"
+#include "smf.hpp"
+
+struct ConvertOptions {
+  // Units are converted on up to this many threads (0 means one per core).
+  int threads = 0;
+  // How far, in cents, simplified pitch bends may stray from the exact pitch
+  // curve. 0 writes every point of the curve.
+  double bend_tolerance = 0;
+  // convert_batch only: reload projects from <file>.ptcache when it was saved
+  // from the same file, and save one otherwise.
+  bool cache = false;
+};
+
+struct ConvertStats {
+  int bend_points_removed = 0; // by pitch curve simplification
+  int events_dropped = 0;      // for not changing their channel's state
+};
 
 // The primary conversion function.
-MidiFile pxtn_to_midi(const pxtnService &pxtn);
+MidiFile pxtn_to_midi(const pxtnService &pxtn,
+                      const ConvertOptions &options = ConvertOptions(),
+                      ConvertStats *stats = nullptr);
+
+// Same conversion, but written as a Standard MIDI File straight to a sink
+// without building a MidiFile, keeping only a few tracks in memory at once.
+// Returns whether every write succeeded.
+bool pxtn_to_smf(const pxtnService &pxtn, SmfSink &sink,
+                 const ConvertOptions &options = ConvertOptions(),
+                 ConvertStats *stats = nullptr);
 
 #endif // CONVERT_HPP
@@ -1,28 +1,155 @@
 #ifndef HISTORICAL_HPP
 #define HISTORICAL_HPP
 
-// A structure that keeps track of a time-varying quantity (starting at time 0).
+#include <algorithm>
 #include <climits>
 #include <iostream>
-#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// A map from times to values, kept as a vector sorted by time. Events come out
+// of pxtone already sorted by clock, so building one is almost always a series
+// of appends, and lookups are binary searches over contiguous memory.
+//
+// Iterators are invalidated by any insertion, like a vector's.
+template <typename T> class TimeMap {
+public:
+  using value_type = std::pair<int, T>;
+  using iterator = typename std::vector<value_type>::iterator;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+  TimeMap() {}
+  TimeMap(std::initializer_list<value_type> init) : entries(init) {}
+
+  iterator begin() { return entries.begin(); }
+  iterator end() { return entries.end(); }
+  const_iterator begin() const { return entries.begin(); }
+  const_iterator end() const { return entries.end(); }
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+  void reserve(size_t n) { entries.reserve(n); }
+
+  iterator lower_bound(int time) {
+    return std::lower_bound(begin(), end(), time, before);
+  }
+  const_iterator lower_bound(int time) const {
+    return std::lower_bound(begin(), end(), time, before);
+  }
+  iterator upper_bound(int time) {
+    return std::upper_bound(begin(), end(), time, after);
+  }
+  const_iterator upper_bound(int time) const {
+    return std::upper_bound(begin(), end(), time, after);
+  }
+
+  // Sets the value at a time. This is constant time when times are set in
+  // order, which is how maps are normally built; out-of-order times fall back
+  // to a sorted insert.
+  T &append(int time, const T &value) {
+    if (!entries.empty() && entries.back().first >= time)
+      return (*this)[time] = value;
+    entries.emplace_back(time, value);
+    return entries.back().second;
+  }
+
+  // Same as std::map::emplace: inserts unless the time is already present.
+  std::pair<iterator, bool> emplace(int time, const T &value) {
+    if (entries.empty() || entries.back().first < time) {
+      entries.emplace_back(time, value);
+      return {end() - 1, true};
+    }
+    iterator it = lower_bound(time);
+    if (it != end() && it->first == time) return {it, false};
+    return {entries.emplace(it, time, value), true};
+  }
+
+  T &operator[](int time) { return emplace(time, T()).first->second; }
 
-template <typename T> class Historical : public std::map<int, T> {
+private:
+  static bool before(const value_type &entry, int time) {
+    return entry.first < time;
+  }
+  static bool after(int time, const value_type &entry) {
+    return time < entry.first;
+  }
+
+  std::vector<value_type> entries;
+};
+
+// A structure that keeps track of a time-varying quantity (starting at time 0).
+template <typename T> class Historical : public TimeMap<T> {
 public:
   // We (softly) enforce an initial value for easier file writing and pitch
   // processing later.
-  Historical(T initial) : std::map<int, T>({{0, initial}}){};
+  Historical(T initial) : TimeMap<T>({{0, initial}}){};
 
   // Get the value of the quantity at the given time.
   T at_time(int time) const {
     // first transition after time
-    auto it = std::map<int, T>::upper_bound(time);
-    if (it == std::map<int, T>::begin())
+    auto it = TimeMap<T>::upper_bound(time);
+    if (it == TimeMap<T>::begin())
       throw std::domain_error("no value at this time");
     else
       return (--it)->second;
   }
+
+  // A reader for lookups at non-decreasing times. It resumes from where the
+  // previous lookup ended instead of searching from scratch, so a forward walk
+  // costs amortized constant time per lookup. A lookup that goes back in time
+  // is still answered correctly, with a binary search. Since only a position
+  // is kept, the historical may be added to while a cursor is in use.
+  class Cursor {
+  public:
+    explicit Cursor(const Historical &hist) : hist(&hist), index(0) {}
+
+    // The entry in effect at the given time.
+    typename TimeMap<T>::const_iterator find(int time) {
+      auto begin = hist->begin();
+      if (index >= hist->size() || begin[index].first > time) {
+        auto it = hist->upper_bound(time);
+        if (it == begin) throw std::domain_error("no value at this time");
+        index = it - begin - 1;
+      }
+      while (index + 1 < hist->size() && begin[index + 1].first <= time)
+        ++index;
+      return begin + index;
+    }
+
+    T at_time(int time) { return find(time)->second; }
+
+  private:
+    const Historical *hist;
+    size_t index;
+  };
+
+  Cursor cursor() const { return Cursor(*this); }
 };
 
+// Combines two historicals into one whose value at any time is
+// op(a.at_time(time), b.at_time(time)), changing whenever either input does.
+// This is a single merge over both inputs, so it's linear in their sizes.
+template <typename A, typename B, typename Op>
+auto combine(const Historical<A> &a, const Historical<B> &b, Op op)
+    -> Historical<decltype(op(a.begin()->second, b.begin()->second))> {
+  using R = decltype(op(a.begin()->second, b.begin()->second));
+  Historical<R> result(op(a.begin()->second, b.begin()->second));
+  result.reserve(a.size() + b.size());
+
+  auto a_it = a.begin(), b_it = b.begin();
+  A a_val = a_it->second;
+  B b_val = b_it->second;
+  while (a_it != a.end() || b_it != b.end()) {
+    int time = INT_MAX;
+    if (a_it != a.end()) time = a_it->first;
+    if (b_it != b.end()) time = std::min(time, b_it->first);
+    if (a_it != a.end() && a_it->first == time) a_val = (a_it++)->second;
+    if (b_it != b.end() && b_it->first == time) b_val = (b_it++)->second;
+    result.append(time, op(a_val, b_val));
+  }
+  return result;
+}
+
 template <typename T>
 std::ostream &operator<<(std::ostream &o, const Historical<T> &hist) {
   for (const auto & [ time, value ] : hist)
@@ -0,0 +1,271 @@
+#ifndef WIN32
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+
+#include "index.hpp"
+#include "parallel.hpp"
+#include "pxtone/pxtnService.h"
+
+// Bump when the columns change; an index in another format is rebuilt.
+static const char INDEX_FORMAT[] = "#ptmidi-index 1";
+static const char INDEX_COLUMNS[] =
+    "path\tmtime\tsize\ttitle\ttempo\tbeat_num\tmeasures\tseconds\tunits\t"
+    "events\twoices";
+static const int INDEX_FIELDS = 11;
+
+// Any rate works; the length in seconds doesn't depend on it.
+static const int32_t LENGTH_SPS = 44100;
+
+static bool is_project(const std::string &name) {
+  for (const char *ext : {".ptcop", ".pttune"}) {
+    size_t n = strlen(ext);
+    if (name.size() > n && !strcasecmp(name.c_str() + name.size() - n, ext))
+      return true;
+  }
+  return false;
+}
+
+// Adds the projects under root/rel to `entries`, with their mtime and size.
+// Hidden entries and symlinks are skipped. Subdirectories that can't be opened
+// are added to `unreadable`; returns false if root/rel itself can't be.
+static bool find_projects(const std::string &root, const std::string &rel,
+                          std::vector<IndexEntry> &entries,
+                          std::vector<std::string> &unreadable) {
+  DIR *dir = opendir(rel.empty() ? root.c_str() : (root + "/" + rel).c_str());
+  if (!dir) return false;
+  while (const dirent *ent = readdir(dir)) {
+    if (ent->d_name[0] == '.') continue;
+    std::string path = rel.empty() ? ent->d_name : rel + "/" + ent->d_name;
+    struct stat st;
+    if (lstat((root + "/" + path).c_str(), &st)) continue;
+    if (S_ISDIR(st.st_mode)) {
+      if (!find_projects(root, path, entries, unreadable))
+        unreadable.push_back(path);
+    } else if (S_ISREG(st.st_mode) && is_project(path)) {
+      entries.emplace_back();
+      entries.back().path = path;
+      entries.back().mtime = st.st_mtime;
+      entries.back().size = st.st_size;
+    }
+  }
+  closedir(dir);
+  return true;
+}
+
+// Titles can hold anything, so tabs, newlines and backslashes are escaped.
+static std::string escape(const std::string &s) {
+  std::string out;
+  for (char c : s) {
+    switch (c) {
+    case '\\': out += "\\\\"; break;
+    case '\t': out += "\\t"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    default: out += c;
+    }
+  }
+  return out;
+}
+
+static std::string unescape(const std::string &s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] != '\\' || i + 1 == s.size()) {
+      out += s[i];
+      continue;
+    }
+    switch (s[++i]) {
+    case 't': out += '\t'; break;
+    case 'n': out += '\n'; break;
+    case 'r': out += '\r'; break;
+    default: out += s[i];
+    }
+  }
+  return out;
+}
+
+static void load_index(const std::string &index_path,
+                       std::unordered_map<std::string, IndexEntry> &entries) {
+  std::ifstream in(index_path, std::ios::binary);
+  std::string line;
+  if (!std::getline(in, line) ||
+      line.substr(0, line.find('\t')) != INDEX_FORMAT)
+    return;
+  while (std::getline(in, line)) {
+    std::vector<std::string> fields;
+    for (size_t start = 0, end;; start = end + 1) {
+      end = line.find('\t', start);
+      fields.push_back(line.substr(start, end - start));
+      if (end == std::string::npos) break;
+    }
+    if (fields.size() != INDEX_FIELDS) continue;
+    IndexEntry entry;
+    entry.path = unescape(fields[0]);
+    entry.mtime = std::atoll(fields[1].c_str());
+    entry.size = std::atoll(fields[2].c_str());
+    entry.title = unescape(fields[3]);
+    entry.tempo = std::atof(fields[4].c_str());
+    entry.beat_num = std::atoi(fields[5].c_str());
+    entry.meas_num = std::atoi(fields[6].c_str());
+    entry.seconds = std::atof(fields[7].c_str());
+    entry.unit_num = std::atoi(fields[8].c_str());
+    entry.event_num = std::atoi(fields[9].c_str());
+    entry.woice_types = fields[10];
+    entries[entry.path] = std::move(entry);
+  }
+}
+
+static bool scan_file(pxtnService &pxtn, pxtnSCANINFO &info,
+                      const std::string &path, IndexEntry &entry,
+                      std::string &error) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    error = "could not open file";
+    return false;
+  }
+  pxtnDescriptor desc;
+  pxtnERR res = pxtnERR_desc_r;
+  if (desc.set_file_map_r(file) || desc.set_file_r(file))
+    res = pxtn.scan(&desc, &info);
+  fclose(file);
+  if (res != pxtnOK) {
+    error = pxtnError_get_string(res);
+    return false;
+  }
+
+  int32_t size = 0;
+  const char *title = info.text.get_name_buf(&size);
+  entry.title = title ? std::string(title, strnlen(title, size)) : "";
+
+  int32_t beat_num, beat_clock, meas_num;
+  float tempo;
+  info.master.Get(&beat_num, &tempo, &beat_clock, &meas_num);
+  entry.tempo = tempo;
+  entry.beat_num = beat_num;
+  entry.meas_num = meas_num;
+  entry.seconds = (double)pxtnService_moo_CalcSampleNum(meas_num, beat_num,
+                                                        LENGTH_SPS, tempo) /
+                  LENGTH_SPS;
+  entry.unit_num = info.unit_num;
+  entry.event_num = info.event_num;
+  entry.woice_types.clear();
+  for (int w = 0; w < info.woice_num; ++w) {
+    switch (info.woice_types[w]) {
+    case pxtnWOICE_PCM: entry.woice_types += 'P'; break;
+    case pxtnWOICE_PTV: entry.woice_types += 'V'; break;
+    case pxtnWOICE_PTN: entry.woice_types += 'N'; break;
+    case pxtnWOICE_OGGV: entry.woice_types += 'O'; break;
+    default: entry.woice_types += '?';
+    }
+  }
+  return true;
+}
+
+static bool write_index(const std::string &index_path,
+                        const std::vector<IndexEntry> &entries,
+                        const std::vector<bool> &keep) {
+  // Written aside and renamed over, so readers never see half an index.
+  std::string tmp_path = index_path + ".tmp";
+  FILE *out = fopen(tmp_path.c_str(), "wb");
+  if (!out) return false;
+  bool ok = fprintf(out, "%s\t%s\n", INDEX_FORMAT, INDEX_COLUMNS) > 0;
+  for (size_t i = 0; ok && i < entries.size(); ++i) {
+    if (!keep[i]) continue;
+    const IndexEntry &e = entries[i];
+    ok = fprintf(out, "%s\t%lld\t%lld\t%s\t%g\t%d\t%d\t%.3f\t%d\t%d\t%s\n",
+                 escape(e.path).c_str(), e.mtime, e.size,
+                 escape(e.title).c_str(), e.tempo, e.beat_num, e.meas_num,
+                 e.seconds, e.unit_num, e.event_num,
+                 e.woice_types.c_str()) > 0;
+  }
+  if (fclose(out) != 0) ok = false;
+  if (ok && rename(tmp_path.c_str(), index_path.c_str()) != 0) ok = false;
+  if (!ok) remove(tmp_path.c_str());
+  return ok;
+}
+
+IndexResult update_index(const std::string &dir, const std::string &index_path,
+                         int threads) {
+  IndexResult result;
+  std::vector<IndexEntry> entries;
+  if (!find_projects(dir, "", entries, result.unreadable)) {
+    result.error = "could not open directory " + dir;
+    return result;
+  }
+
+  std::unordered_map<std::string, IndexEntry> previous;
+  load_index(index_path, previous);
+  // Lines under a directory that couldn't be read are kept as they were,
+  // rather than dropped and all scanned again next time.
+  for (const auto &prev : previous) {
+    for (const std::string &rel : result.unreadable) {
+      if (prev.first.compare(0, rel.size() + 1, rel + "/") == 0) {
+        entries.push_back(prev.second);
+        break;
+      }
+    }
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const IndexEntry &a, const IndexEntry &b) {
+              return a.path < b.path;
+            });
+  result.files = entries.size();
+
+  std::vector<int> stale;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    auto found = previous.find(entries[i].path);
+    if (found != previous.end() && found->second.mtime == entries[i].mtime &&
+        found->second.size == entries[i].size)
+      entries[i] = std::move(found->second);
+    else
+      stale.push_back(i);
+  }
+  result.reused = entries.size() - stale.size();
+
+  std::vector<BatchResult> scans(stale.size());
+  parallel_for(stale.size(), threads, [&]() {
+    // shared_ptr so the worker lambda stays copyable; neither is.
+    auto pxtn = std::make_shared<pxtnService>();
+    auto info = std::make_shared<pxtnSCANINFO>();
+    pxtnERR init_res = pxtn->init();
+    return [&, pxtn, info, init_res](int s) {
+      IndexEntry &entry = entries[stale[s]];
+      BatchResult &scan = scans[s];
+      scan.path = entry.path;
+      if (init_res != pxtnOK) {
+        scan.ok = false;
+        scan.error = pxtnError_get_string(init_res);
+      } else {
+        scan.ok = scan_file(*pxtn, *info, dir + "/" + entry.path, entry,
+                            scan.error);
+      }
+    };
+  });
+
+  std::vector<bool> keep(entries.size(), true);
+  for (size_t s = 0; s < stale.size(); ++s) {
+    if (scans[s].ok) {
+      ++result.scanned;
+    } else {
+      keep[stale[s]] = false;
+      result.failures.push_back(scans[s]);
+    }
+  }
+
+  result.ok = write_index(index_path, entries, keep);
+  if (!result.ok) result.error = "could not write " + index_path;
+  return result;
+}
+
+#endif // WIN32
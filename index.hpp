@@ -0,0 +1,44 @@
+#ifndef INDEX_HPP
+#define INDEX_HPP
+
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+
+// One line of the index: what a catalog needs to list a project without
+// opening it.
+struct IndexEntry {
+  std::string path;              // relative to the indexed directory
+  long long mtime = 0, size = 0; // of the file when it was scanned
+  std::string title;
+  float tempo = 0;
+  int beat_num = 0;
+  int meas_num = 0;
+  double seconds = 0;
+  int unit_num = 0;
+  int event_num = 0;
+  // One letter per woice: P (PCM), V (ptvoice), N (ptnoise), O (Ogg Vorbis).
+  std::string woice_types;
+};
+
+struct IndexResult {
+  bool ok = false; // whether the index was written
+  std::string error;
+  int files = 0, scanned = 0, reused = 0;
+  std::vector<BatchResult> failures; // files that couldn't be scanned
+  // Subdirectories that couldn't be read; their lines in the previous index
+  // were kept.
+  std::vector<std::string> unreadable;
+};
+
+// Brings the index of every .ptcop/.pttune under `dir` up to date in
+// `index_path`, a tab-separated file with one line per project. Files with
+// the same mtime and size as in the previous index keep their line; the rest
+// are scanned (see pxtnService::scan) on a pool of `threads` workers (0 means
+// one per core). Files that fail to scan are left out, so they're retried
+// next time; subdirectories that can't be read keep their previous lines.
+IndexResult update_index(const std::string &dir, const std::string &index_path,
+                         int threads);
+
+#endif // INDEX_HPP
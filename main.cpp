@@ -1,26 +1,143 @@
 #ifndef WIN32
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 
-#include "convert.hpp"
+#include "batch.hpp"
+#include "index.hpp"
+
+static void usage(const char *name) {
+  std::cerr << "usage: " << name
+            << " [-j threads] [--cache] [--bend-tolerance cents]"
+               " [--files-from list|-] my_file.ptcop...|-\n"
+            << "       " << name << " index [-j threads] dir [index-file]"
+            << std::endl;
+}
+
+static bool read_file_list(std::istream &in, std::vector<std::string> &paths) {
+  std::string line;
+  while (std::getline(in, line))
+    if (!line.empty()) paths.push_back(line);
+  return !in.bad();
+}
+
+// ptmidi index: catalogs a directory tree instead of converting.
+static int index_main(int argc, char **args) {
+  int threads = 0;
+  std::vector<std::string> positional;
+  for (int i = 2; i < argc; ++i) {
+    if (!strcmp(args[i], "-j") && i + 1 < argc) {
+      threads = std::atoi(args[++i]);
+    } else if (args[i][0] == '-') {
+      usage(args[0]);
+      return 1;
+    } else {
+      positional.push_back(args[i]);
+    }
+  }
+  if (positional.empty() || positional.size() > 2) {
+    usage(args[0]);
+    return 1;
+  }
+  const std::string &dir = positional[0];
+  std::string index_path =
+      positional.size() > 1 ? positional[1] : dir + "/ptmidi-index.tsv";
+
+  auto start = std::chrono::steady_clock::now();
+  IndexResult result = update_index(dir, index_path, threads);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  for (const BatchResult &failure : result.failures)
+    std::cerr << "failed: " << failure.path << ": " << failure.error
+              << std::endl;
+  for (const std::string &rel : result.unreadable)
+    std::cerr << "could not read " << rel << ", kept its previous lines"
+              << std::endl;
+  if (!result.ok) {
+    std::cerr << result.error << std::endl;
+    return 1;
+  }
+  std::cerr << result.files - result.failures.size() << "/" << result.files
+            << " files indexed (" << result.scanned << " scanned, "
+            << result.reused << " unchanged) in " << elapsed.count() << "s"
+            << std::endl;
+  return result.failures.empty() && result.unreadable.empty() ? 0 : 1;
+}
 
 int main(int argc, char **args) {
-  // read file
-  if (argc != 2) {
-    std::cerr << "usage: " << args[0] << " my_file.ptcop" << std::endl;
+  if (argc > 1 && !strcmp(args[1], "index")) return index_main(argc, args);
+
+  std::vector<std::string> paths;
+  ConvertOptions options;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(args[i], "-j") && i + 1 < argc) {
+      options.threads = std::atoi(args[++i]);
+    } else if (!strcmp(args[i], "--cache")) {
+      options.cache = true;
+    } else if (!strcmp(args[i], "--bend-tolerance") && i + 1 < argc) {
+      options.bend_tolerance = std::atof(args[++i]);
+    } else if (!strcmp(args[i], "--files-from") && i + 1 < argc) {
+      const char *list = args[++i];
+      std::ifstream file;
+      if (strcmp(list, "-")) file.open(list);
+      if (!read_file_list(strcmp(list, "-") ? file : std::cin, paths)) {
+        std::cerr << "could not read file list " << list << std::endl;
+        return 1;
+      }
+    } else if (!strcmp(args[i], "-")) {
+      paths.push_back(args[i]);
+    } else if (args[i][0] == '-') {
+      usage(args[0]);
+      return 1;
+    } else {
+      paths.push_back(args[i]);
+    }
+  }
+  if (paths.empty()) {
+    usage(args[0]);
     return 0;
   }
-  char *filename = args[1];
-  FILE *file = fopen(args[1], "r");
-  pxtnDescriptor desc;
-  desc.set_file_r(file);
-  pxtnService pxtn;
-  pxtn.init();
-  pxtn.read(&desc);
-  fclose(file);
-
-  pxtn_to_midi(pxtn).write(string(filename) + ".mid");
-  return 0;
+  // the MIDI file goes to stdout, which can't be shared
+  if (paths.size() > 1 &&
+      std::find(paths.begin(), paths.end(), "-") != paths.end()) {
+    std::cerr << "- (stdin) can't be converted along with other files"
+              << std::endl;
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<BatchResult> results = convert_batch(paths, options);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  int failed = 0, bend_points_removed = 0, events_dropped = 0;
+  for (const BatchResult &result : results) {
+    bend_points_removed += result.stats.bend_points_removed;
+    events_dropped += result.stats.events_dropped;
+    if (result.ok) {
+      if (results.size() > 1) std::cout << "ok: " << result.path << std::endl;
+    } else {
+      std::cerr << "failed: " << result.path << ": " << result.error
+                << std::endl;
+      ++failed;
+    }
+  }
+  if (options.bend_tolerance > 0)
+    std::cerr << "pitch bend simplification removed " << bend_points_removed
+              << " points" << std::endl;
+  if (results.size() > 1) {
+    std::cerr << events_dropped << " events that didn't change anything were "
+              << "dropped" << std::endl;
+    std::cerr << results.size() - failed << "/" << results.size()
+              << " files converted in " << elapsed.count() << "s ("
+              << results.size() / elapsed.count() << " files/s)" << std::endl;
+  }
+  return failed ? 1 : 0;
 }
 
 #endif // WIN32
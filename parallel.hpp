@@ -0,0 +1,41 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller asks for 0 (i.e. "auto").
+inline int default_thread_count() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Runs jobs 0..count-1 on a fixed pool of at most `threads` workers (0 means
+// one per core). make_worker() is called once on each worker thread and must
+// return a callable taking a job index, so a worker can hold on to expensive
+// state (e.g. a pxtnService) between the jobs it picks up. Jobs are handed out
+// in index order, but may finish in any order.
+template <typename MakeWorker>
+void parallel_for(int count, int threads, MakeWorker make_worker) {
+  if (threads <= 0) threads = default_thread_count();
+  threads = std::min(threads, count);
+  if (threads <= 1) {
+    auto work = make_worker();
+    for (int i = 0; i < count; ++i) work(i);
+    return;
+  }
+
+  std::atomic<int> next(0);
+  auto run = [&]() {
+    auto work = make_worker();
+    for (int i; (i = next++) < count;) work(i);
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 1; t < threads; ++t) pool.emplace_back(run);
+  run();
+  for (std::thread &thread : pool) thread.join();
+}
+
+#endif // PARALLEL_HPP
@@ -1,9 +1,37 @@
+#include <cmath>
+
 #include "pitch_bend.hpp"
 
 static double lerp(double a, double b, int num, int denom) {
   return (a * (denom - num) + b * num) / denom;
 }
 
+PortaPitchCurve::PortaPitchCurve(const TimeMap<Press> &presses,
+                                 const Historical<int> &notes,
+                                 const Historical<int> &portas)
+    : press_it(presses.begin()), press_end(presses.end()),
+      note_at(notes.cursor()), note_end(notes.cursor()),
+      porta_at(portas.cursor()), porta_end(portas.cursor()) {}
+
+// Points are produced by step() in non-decreasing time, and a later point at
+// the same time replaces an earlier one, so each is held back until the next
+// one shows it wasn't replaced.
+bool PortaPitchCurve::next(PitchPoint &point) {
+  if (!has_pending) return false;
+  PitchPoint stepped;
+  while ((has_pending = step(stepped)) && stepped.time == pending.time)
+    pending = stepped;
+  point = pending;
+  pending = stepped;
+  return true;
+}
+
+bool PortaPitchCurve::set(PitchPoint &point, int time, double value) {
+  point = {time, value};
+  offset = value;
+  return true;
+}
+
 // Changing portamento times within a note is complicated. From what I gather
 // looking at the source code (pxtnUnit::Tone_Increment_Key) and experiments,
 // what happens at a mid-note portamento change is:
@@ -37,82 +65,149 @@ static double lerp(double a, double b, int num, int denom) {
 //
 // To avoid all of this likely undesired behaviour, write ptcop files with
 // (possibly empty) note changes at each portamento time change.
-Historical<double> porta_pitch_offsets(const std::map<int, Press> &presses,
-                                       const Historical<int> &notes,
-                                       const Historical<int> &portas) {
-  Historical<double> offsets(0);
-  for (const auto & [ press_time, press ] : presses) {
-    if (offsets.at_time(press_time) != 0) offsets[press_time] = 0;
-    int base_key = notes.at_time(press_time);
-    auto key_bound = notes.lower_bound(press_time + press.length);
-    auto key_it = notes.upper_bound(press_time);
-    while (key_it != key_bound) {
-      const auto & [ key_time, key ] = *key_it;
-      double curr_off = offsets.at_time(key_time);
-      double dest_off = key - base_key;
+//
+// The sweep is a loop over presses, over the key changes in each press, over
+// the portamento times in each key change and over the points of each slide,
+// unrolled into a state machine so that it can stop at every point.
+bool PortaPitchCurve::step(PitchPoint &point) {
+  constexpr int incr = 10;
+  for (;;) {
+    switch (state) {
+    case PRESS: {
+      if (press_it == press_end) return false;
+      press_time = press_it->first;
+      press_length = press_it->second.length;
+      // pxtone cuts a press short at the next one, and the curve has to stay
+      // in time order, so an overlapping press ends there too.
+      if (++press_it != press_end)
+        press_length = std::min(press_length, press_it->first - press_time);
+
+      key_it = note_at.find(press_time);
+      base_key = key_it->second;
+      ++key_it;
+      // first key change at or after the end of the press
+      key_bound = key_it;
+      if (press_length > 0)
+        key_bound = note_end.find(press_time + press_length - 1) + 1;
+      state = KEY;
+      if (offset != 0) return set(point, press_time, 0);
+      break;
+    }
+
+    case KEY: {
+      if (key_it >= key_bound) {
+        state = PRESS;
+        break;
+      }
+      key_time = key_it->first;
+      curr_off = offset;
+      dest_off = key_it->second - base_key;
 
       ++key_it;
-      if (dest_off == curr_off) continue;
+      if (dest_off == curr_off) break;
 
       // available length for this note
-      int avail_note_length = press_time + press.length - key_time;
+      avail_note_length = press_time + press_length - key_time;
       if (key_it != key_bound && key_it->first - key_time < avail_note_length)
         avail_note_length = key_it->first - key_time;
 
-      constexpr int incr = 10;
-      auto porta_it = --portas.upper_bound(key_time);
-      auto porta_bound = portas.lower_bound(key_time + avail_note_length);
-      for (; porta_it != porta_bound; ++porta_it) {
-        // restrict porta_time for the for loop later down
-        int porta_time = std::max(porta_it->first, key_time);
-        int porta = porta_it->second;
-
-        // available length for this block of portamento in this note
-        auto next_porta = porta_it;
-        ++next_porta;
-        int avail_porta_length = avail_note_length;
-        if (next_porta != porta_bound &&
-            avail_porta_length > next_porta->first - key_time)
-          avail_porta_length = next_porta->first - key_time;
-
-        for (int i = porta_time - key_time;
-             i < std::min(avail_porta_length, porta); i += incr)
-          offsets[key_time + i] = lerp(curr_off, dest_off, i, porta);
-
-        // if this porta finished, don't start the next one.
-        if (porta <= avail_porta_length) {
-          offsets[key_time + porta] = dest_off;
-          break;
-        }
+      porta_it = porta_at.find(key_time);
+      porta_bound = porta_end.find(key_time + avail_note_length - 1) + 1;
+      state = PORTA;
+      break;
+    }
+
+    case PORTA: {
+      // no portamento finished, so the slide is cut off at the end of this
+      // note. The last porta is nonzero, or else it would've finished.
+      if (porta_it == porta_bound) {
+        state = KEY;
+        porta = (porta_bound - 1)->second;
+        return set(point, key_time + avail_note_length,
+                   lerp(curr_off, dest_off, avail_note_length, porta));
       }
+      // restrict porta_time for the slide
+      int porta_time = std::max(porta_it->first, key_time);
+      porta = porta_it->second;
+
+      // available length for this block of portamento in this note
+      auto next_porta = porta_it + 1;
+      avail_porta_length = avail_note_length;
+      if (next_porta != porta_bound &&
+          avail_porta_length > next_porta->first - key_time)
+        avail_porta_length = next_porta->first - key_time;
 
-      // porta_it is the first portamento that finished. if it's porta_bound,
-      // no portamento finished, in which case we calculate and the correct
-      // pitch offset for the end of this note.
-      if (porta_it == porta_bound && porta_it != portas.begin()) {
-        int porta = (--porta_bound)->second;
-        // porta is nonzero, or else it would've finished before the note end.
-        offsets[key_time + avail_note_length] =
-            lerp(curr_off, dest_off, avail_note_length, porta);
+      slide_start = slide_pos = porta_time - key_time;
+      slide_end = std::min(avail_porta_length, porta);
+      state = SLIDE;
+      break;
+    }
+
+    case SLIDE: {
+      if (slide_pos < slide_end) {
+        int i = slide_pos;
+        slide_pos += incr;
+        return set(point, key_time + i, lerp(curr_off, dest_off, i, porta));
+      }
+      // if this porta finished, don't start the next one. A porta changed to
+      // less than the time already taken finishes as soon as it's changed.
+      if (porta <= avail_porta_length) {
+        state = KEY;
+        return set(point, key_time + std::max(porta, slide_start), dest_off);
       }
+      ++porta_it;
+      state = PORTA;
+      break;
     }
+    }
+  }
+}
+
+PitchCurve::PitchCurve(const Unit &unit, double tolerance)
+    : porta(unit.presses, unit.notes, unit.portas),
+      tuning_it(unit.tunings.begin()), tuning_end(unit.tunings.end()),
+      tolerance(tolerance) {
+  has_porta = porta.next(porta_next);
+  has_ahead = next_exact(ahead);
+}
+
+// The sum of the portamento and tuning offsets, with a point whenever either
+// of them changes.
+bool PitchCurve::next_exact(PitchPoint &point) {
+  if (!has_porta && tuning_it == tuning_end) return false;
+  int time = INT_MAX;
+  if (has_porta) time = porta_next.time;
+  if (tuning_it != tuning_end) time = std::min(time, tuning_it->first);
+  if (has_porta && porta_next.time == time) {
+    porta_offset = porta_next.offset;
+    has_porta = porta.next(porta_next);
   }
-  return offsets;
+  if (tuning_it != tuning_end && tuning_it->first == time)
+    tuning = (tuning_it++)->second;
+  point = {time, porta_offset + tuning};
+  return true;
 }
 
-// Given two historicals, sets the first equal to the "sum" of the two.
-void add_pitch_offset(Historical<double> &base, const Historical<double> &add) {
-  auto new_it = add.begin();
-  while (new_it != add.end()) {
-    const auto & [ new_time, new_pitch ] = *new_it;
-    double current_offset = base.at_time(new_time);
-    ++new_it;
-
-    auto offset_it = base.emplace(new_time, current_offset).first;
-    while (offset_it != base.end() &&
-           (new_it == add.end() || offset_it->first < new_it->first)) {
-      offset_it->second += new_pitch;
-      ++offset_it;
+// A bend holds until the next one, so a point can go when it's within the
+// tolerance of the last point kept. Points where the curve settles (the next
+// point is further away than the previous one, like at the end of a
+// portamento) are always kept so that a small error isn't held for the rest
+// of a note.
+bool PitchCurve::next(PitchPoint &point) {
+  while (has_ahead) {
+    point = ahead;
+    has_ahead = next_exact(ahead);
+    bool settles =
+        (!has_ahead || ahead.time - point.time > point.time - prev_time);
+    prev_time = point.time;
+    if (started && tolerance > 0 && !settles &&
+        std::abs(point.offset - held) <= tolerance) {
+      ++num_removed;
+      continue;
     }
+    started = true;
+    held = point.offset;
+    return true;
   }
+  return false;
 }
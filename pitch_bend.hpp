@@ -1,8 +1,80 @@
+#ifndef PITCH_BEND_HPP
+#define PITCH_BEND_HPP
+
 #include "historical.hpp"
 #include "pttypes.hpp"
 
-Historical<double> porta_pitch_offsets(const std::map<int, Press> &presses,
-                                       const Historical<int> &notes,
-                                       const Historical<int> &portas);
+// The pitch of a unit from a time until the next point, as an offset in
+// semitones from the key of the note playing.
+struct PitchPoint {
+  int time;
+  double offset;
+};
+
+// A unit's pitch offsets from portamento, generated a point at a time in one
+// forward sweep over its presses, keys and portamento times.
+class PortaPitchCurve {
+public:
+  PortaPitchCurve(const TimeMap<Press> &presses, const Historical<int> &notes,
+                  const Historical<int> &portas);
+
+  // Gets the next point, in time order. Returns false after the last one.
+  bool next(PitchPoint &point);
+
+private:
+  bool step(PitchPoint &point);
+  bool set(PitchPoint &point, int time, double offset);
+
+  enum State { PRESS, KEY, PORTA, SLIDE };
+  State state = PRESS;
+  double offset = 0;
+
+  TimeMap<Press>::const_iterator press_it, press_end;
+  int press_time, press_length, base_key;
+
+  Historical<int>::const_iterator key_it, key_bound;
+  Historical<int>::Cursor note_at, note_end;
+  int key_time, avail_note_length;
+  double curr_off, dest_off;
+
+  Historical<int>::const_iterator porta_it, porta_bound;
+  Historical<int>::Cursor porta_at, porta_end;
+  int porta, avail_porta_length, slide_start, slide_pos, slide_end;
+
+  bool has_pending = true;
+  PitchPoint pending = {0, 0};
+};
+
+// A unit's full pitch offsets, portamento plus tuning. With a nonzero
+// `tolerance` (in semitones), points are left out as long as the played pitch
+// is never more than that far off at any of the exact curve's points.
+class PitchCurve {
+public:
+  PitchCurve(const Unit &unit, double tolerance = 0);
+
+  // Gets the next point, in time order. Returns false after the last one.
+  bool next(PitchPoint &point);
+
+  // How many points of the exact curve have been left out so far.
+  int removed() const { return num_removed; }
+
+private:
+  bool next_exact(PitchPoint &point);
+
+  PortaPitchCurve porta;
+  bool has_porta;
+  PitchPoint porta_next;
+  double porta_offset = 0;
+
+  Historical<double>::const_iterator tuning_it, tuning_end;
+  double tuning = 0;
+
+  double tolerance;
+  bool has_ahead, started = false;
+  PitchPoint ahead;
+  int prev_time = 0;
+  double held = 0;
+  int num_removed = 0;
+};
 
-void add_pitch_offset(Historical<double> &base, const Historical<double> &add);
+#endif // PITCH_BEND_HPP
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+
 #include "pttypes.hpp"
 
 std::ostream &operator<<(std::ostream &o, const EVERECORD &p) {
@@ -31,63 +34,103 @@ std::vector<Woice> Woice::get_woices(const pxtnService &pxtn) {
   return woices;
 }
 
+// Appends the first `num` entries of an event column to a historical.
+template <typename T, typename F>
+static void append_column(Historical<T> &hist, const int32_t *clocks,
+                          const int32_t *values, int32_t num, F convert) {
+  hist.reserve(hist.size() + num);
+  for (int32_t i = 0; i < num; ++i) hist.append(clocks[i], convert(values[i]));
+}
+
 std::vector<Unit> Unit::get_units(const pxtnService &pxtn) {
   std::vector<Unit> units(pxtn.Unit_Num());
-  for (const EVERECORD *p = pxtn.evels->get_Records(); p; p = p->next) {
-    if (p->clock >= pxtn.master->get_last_clock() &&
-        pxtn.master->get_last_clock() > 0)
-      continue;
-    switch (p->kind) {
-    case EVENTKIND_ON: {
-      auto &hist = units[p->unit_no].presses;
-      hist.emplace(p->clock, Press{}).first->second.length = p->value;
-      break;
-    }
-
-    case EVENTKIND_VELOCITY: {
-      auto &hist = units[p->unit_no].presses;
-      hist.emplace(p->clock, Press{}).first->second.vel = p->value;
-      break;
+  const int32_t last_clock = pxtn.master->get_last_clock();
+  auto identity = [](int32_t value) { return (int)value; };
+
+  for (int u = 0; u < pxtn.Unit_Num(); ++u) {
+    Unit &unit = units[u];
+    const int32_t *clocks[EVENTKIND_NUM], *values[EVENTKIND_NUM];
+    int32_t nums[EVENTKIND_NUM];
+    for (int kind = 0; kind < EVENTKIND_NUM; ++kind) {
+      nums[kind] =
+          pxtn.evels->get_Column(u, kind, &clocks[kind], &values[kind]);
+      // Events at or past the last clock never play.
+      if (last_clock > 0)
+        nums[kind] = std::lower_bound(clocks[kind], clocks[kind] + nums[kind],
+                                      last_clock) -
+                     clocks[kind];
     }
 
-    case EVENTKIND_KEY:
-      units[p->unit_no].notes[p->clock] = p->value / 256 - 27;
-      break;
-
-    case EVENTKIND_TUNING: {
-      auto &hist = units[p->unit_no].tunings;
-      float value = reinterpret_cast<const float &>(p->value);
-      units[p->unit_no].tunings[p->clock] = std::log2(value) * 12;
-      break;
+    // Presses pair each ON with the VELOCITY at the same clock, so the two
+    // columns are merged to keep the map built by appends.
+    {
+      const int32_t on = EVENTKIND_ON, vel = EVENTKIND_VELOCITY;
+      int32_t i = 0, j = 0;
+      while (i < nums[on] || j < nums[vel]) {
+        int32_t clock = INT32_MAX;
+        if (i < nums[on]) clock = clocks[on][i];
+        if (j < nums[vel]) clock = std::min(clock, clocks[vel][j]);
+        Press &press = unit.presses.emplace(clock, Press{}).first->second;
+        if (i < nums[on] && clocks[on][i] == clock)
+          press.length = values[on][i++];
+        if (j < nums[vel] && clocks[vel][j] == clock)
+          press.vel = values[vel][j++];
+      }
     }
 
-    case EVENTKIND_PORTAMENT:
-      units[p->unit_no].portas[p->clock] = p->value;
-      break;
-
-    case EVENTKIND_VOLUME:
-      units[p->unit_no].volume[p->clock] = p->value;
-      break;
-
-    case EVENTKIND_PAN_VOLUME:
-      units[p->unit_no].pan_v[p->clock] = p->value;
-      break;
-
-    case EVENTKIND_PAN_TIME:
-      units[p->unit_no].pan_t[p->clock] = p->value;
-      break;
-
-    case EVENTKIND_VOICENO:
-      units[p->unit_no].voice[p->clock] = p->value;
-      break;
-
-    case EVENTKIND_GROUPNO:
-      units[p->unit_no].group[p->clock] = p->value;
-      break;
-
-    default:
-      std::cerr << "warning: unhandled event - " << *p << std::endl;
-      break;
+    for (int kind = 0; kind < EVENTKIND_NUM; ++kind) {
+      const int32_t *c = clocks[kind], *v = values[kind];
+      int32_t n = nums[kind];
+      switch (kind) {
+      case EVENTKIND_ON:
+      case EVENTKIND_VELOCITY: break;
+
+      case EVENTKIND_KEY:
+        append_column(unit.notes, c, v, n,
+                      [](int32_t value) { return value / 256 - 27; });
+        break;
+
+      case EVENTKIND_TUNING:
+        append_column(unit.tunings, c, v, n, [](int32_t value) {
+          return std::log2(reinterpret_cast<const float &>(value)) * 12;
+        });
+        break;
+
+      case EVENTKIND_PORTAMENT:
+        append_column(unit.portas, c, v, n, identity);
+        break;
+
+      case EVENTKIND_VOLUME:
+        append_column(unit.volume, c, v, n, identity);
+        break;
+
+      case EVENTKIND_PAN_VOLUME:
+        append_column(unit.pan_v, c, v, n, identity);
+        break;
+
+      case EVENTKIND_PAN_TIME:
+        append_column(unit.pan_t, c, v, n, identity);
+        break;
+
+      case EVENTKIND_VOICENO:
+        append_column(unit.voice, c, v, n, identity);
+        break;
+
+      case EVENTKIND_GROUPNO:
+        append_column(unit.group, c, v, n, identity);
+        break;
+
+      default:
+        for (int32_t i = 0; i < n; ++i) {
+          EVERECORD rec = {};
+          rec.kind = kind;
+          rec.unit_no = u;
+          rec.clock = c[i];
+          rec.value = v[i];
+          std::cerr << "warning: unhandled event - " << rec << std::endl;
+        }
+        break;
+      }
     }
   }
 
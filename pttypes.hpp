@@ -26,7 +26,7 @@ struct Woice {
 struct Unit {
   // not a historical since it's not exactly a time-varying quantity, but a
   // bunch of presses at different times.
-  std::map<int, Press> presses;
+  TimeMap<Press> presses;
 
   Historical<int> notes, portas;
   Historical<double> tunings;
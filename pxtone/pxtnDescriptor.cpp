@@ -3,20 +3,146 @@
 
 #include "./pxtnDescriptor.h"
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 pxtnDescriptor::pxtnDescriptor()
 {
 	_p_desc = NULL ;
 	_size   =     0;
 	_b_file = false;
 	_b_read = false;
+	_b_map  = false;
+	_b_own  = false;
 	_cur    =     0;
+	_cap    =     0;
+	_p_buf  = NULL ;
+	_buf_pos=     0;
+	_buf_len=     0;
+}
+
+pxtnDescriptor::~pxtnDescriptor()
+{
+	_release();
+}
+
+void pxtnDescriptor::_release()
+{
+	if( _b_file && !_b_read ) w_flush();
+#ifndef _WIN32
+	if( _b_map ) munmap( _p_desc, _size );
+#endif
+	if( _b_own ) free( _p_desc );
+	if( _p_buf ) free( _p_buf );
+	_p_buf  = NULL ;
+	_buf_pos=     0;
+	_buf_len=     0;
+	_b_map  = false;
+	_b_own  = false;
+	_cap    =     0;
+	_p_desc = NULL ;
+}
+
+// reads ahead until at least want bytes are buffered, or the file ends.
+bool pxtnDescriptor::_buf_fill( int32_t want )
+{
+	int32_t left = _buf_len - _buf_pos;
+	if( left >= want ) return true;
+
+	memmove( _p_buf, _p_buf + _buf_pos, left );
+	_buf_pos = 0;
+	_buf_len = left + (int32_t)fread( _p_buf + left, 1, _BUFSIZE_READ - left, (FILE*)_p_desc );
+	return _buf_len >= want;
+}
+
+// makes room for at least want bytes, doubling.
+bool pxtnDescriptor::_mem_grow( int32_t want )
+{
+	int32_t cap = _cap ? _cap : _BUFSIZE_HEEP;
+	while( cap < want ) cap = ( cap > INT32_MAX / 2 ) ? INT32_MAX : cap * 2;
+
+	void *p = realloc( _p_desc, cap );
+	if( !p ) return false;
+	_p_desc = p  ;
+	_cap    = cap;
+	return true;
+}
+
+// writes out what's buffered, leaving the file at the write position.
+bool pxtnDescriptor::w_flush()
+{
+	if( !_p_desc || !_b_file || _b_read || !_buf_len ) return true;
+
+	bool b_ret = ( fwrite( _p_buf, 1, _buf_len, (FILE*)_p_desc ) == (size_t)_buf_len );
+	if( b_ret && _buf_pos != _buf_len ) b_ret = !fseek( (FILE*)_p_desc, _buf_pos - _buf_len, SEEK_CUR );
+	_buf_pos = _buf_len = 0;
+	return b_ret;
+}
+
+bool pxtnDescriptor::_w( const void *p, int32_t bytes )
+{
+	if( _b_file )
+	{
+		if( _buf_pos + bytes > _BUFSIZE_WRITE )
+		{
+			if( !w_flush() ) return false;
+			// big writes (payloads) go straight to the file.
+			if( bytes > _BUFSIZE_WRITE )
+			{
+				if( fwrite( p, 1, bytes, (FILE*)_p_desc ) != (size_t)bytes ) return false;
+				_size += bytes;
+				return true;
+			}
+		}
+		memcpy( _p_buf + _buf_pos, p, bytes );
+		_buf_pos += bytes;
+		if( _buf_len < _buf_pos ) _buf_len = _buf_pos;
+		_size += bytes;
+	}
+	else
+	{
+		if( bytes > INT32_MAX - _cur ) return false;
+		if( _cur + bytes > _cap && !_mem_grow( _cur + bytes ) ) return false;
+		memcpy( (uint8_t*)_p_desc + _cur, p, bytes );
+		_cur += bytes;
+		if( _size < _cur ) _size = _cur;
+	}
+	return true;
+}
+
+const void *pxtnDescriptor::get_p_mem() const
+{
+	if( _b_file || _b_read ) return NULL;
+	return _p_desc;
+}
+
+const uint8_t *pxtnDescriptor::get_p_cur( int32_t *p_left ) const
+{
+	if( !_p_desc || _b_file || !_b_read ) return NULL;
+	*p_left = _size - _cur;
+	return (const uint8_t*)_p_desc + _cur;
 }
 
 int pxtnDescriptor::get_size_bytes() const { return _size; }
 
+int pxtnDescriptor::tell() const
+{
+	if( !_p_desc ) return -1;
+	if( !_b_file ) return _cur;
+
+	long pos = ftell( (FILE*)_p_desc );
+	if( pos < 0 ) return -1;
+	// the file is ahead of a reader by what's left in the buffer, and behind a writer by what's pending.
+	if( _b_read ) return (int)( pos - ( _buf_len - _buf_pos ) );
+	return (int)( pos + _buf_pos );
+}
+
 bool pxtnDescriptor::set_memory_r( void *p_mem, int size )
 {
 	if( !p_mem || size < 1 ) return false;
+	_release();
 	_p_desc = p_mem;
 	_size   = size ;
 	_b_file = false;
@@ -29,9 +155,11 @@ bool pxtnDescriptor::set_file_r  ( FILE *fd )
 {
 	if( !fd ) return false;
 
+	_release();
 	if( fseek( fd, 0, SEEK_END ) ) return false;
 	_size = (int32_t)ftell( fd );
 	if( fseek( fd, 0, SEEK_SET ) ) return false;
+	if( !( _p_buf = (uint8_t*)malloc( _BUFSIZE_READ ) ) ) return false;
 	_p_desc = fd  ;
 
 	_b_file = true;
@@ -40,10 +168,40 @@ bool pxtnDescriptor::set_file_r  ( FILE *fd )
 	return true;
 }
 
+// Reads are served straight from the mapped pages, as with set_memory_r(),
+// instead of going through stdio. Only regular files can be mapped.
+bool pxtnDescriptor::set_file_map_r( FILE *fd )
+{
+#ifdef _WIN32
+	return set_file_r( fd );
+#else
+	if( !fd ) return false;
+
+	struct stat st;
+	if( fstat( fileno( fd ), &st ) ) return false;
+	if( !S_ISREG( st.st_mode ) || st.st_size < 1 || st.st_size > INT32_MAX ) return false;
+
+	void *p_map = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno( fd ), 0 );
+	if( p_map == MAP_FAILED ) return false;
+	madvise( p_map, (size_t)st.st_size, MADV_SEQUENTIAL );
+
+	_release();
+	_p_desc = p_map;
+	_size   = (int32_t)st.st_size;
+	_b_file = false;
+	_b_read = true ;
+	_b_map  = true ;
+	_cur    =     0;
+	return true;
+#endif
+}
+
 bool pxtnDescriptor::set_file_w  ( FILE *fd )
 {
 	if( !fd ) return false;
 
+	_release();
+	if( !( _p_buf = (uint8_t*)malloc( _BUFSIZE_WRITE ) ) ) return false;
 	_p_desc = fd   ;
 	_size   =    0 ;
 	_b_file = true ;
@@ -52,29 +210,61 @@ bool pxtnDescriptor::set_file_w  ( FILE *fd )
 	return true;
 }
 
+bool pxtnDescriptor::set_memory_w( int32_t reserve )
+{
+	if( reserve < 0 ) return false;
+
+	_release();
+	_size   =    0 ;
+	_b_file = false;
+	_b_read = false;
+	_b_own  = true ;
+	_cur    =    0 ;
+	if( !_mem_grow( reserve ) ) return false;
+	return true;
+}
+
 bool pxtnDescriptor::seek( pxtnSEEK mode, int val )
 {
 	if( _b_file )
 	{
+		// within what's buffered.
+		if( mode == pxtnSEEK_cur && _buf_pos + val >= 0 && _buf_pos + val <= _buf_len )
+		{
+			_buf_pos += val;
+			return true;
+		}
+		if( !_b_read )
+		{
+			if( !w_flush() ) return false;
+		}
+		else
+		{
+			// the file is ahead of the reader by what's left in the buffer.
+			if( mode == pxtnSEEK_cur ) val -= _buf_len - _buf_pos;
+			_buf_pos = _buf_len = 0;
+		}
+
 		int seek_tbl[ pxtnSEEK_num ] = {SEEK_SET, SEEK_CUR, SEEK_END};
 		if( fseek( (FILE*)_p_desc, val, seek_tbl[ mode ] ) ) return false;
 	}
 	else
 	{
+		// like fseek, the end itself is a valid position.
 		switch( mode )
 		{
 		case pxtnSEEK_set:
-			if( val >=         _size ) return false;
+			if( val >          _size ) return false;
 			if( val <              0 ) return false;
 			_cur = val;
 			break;
 		case pxtnSEEK_cur:
-			if( _cur  + val >= _size ) return false;
+			if( _cur  + val >  _size ) return false;
 			if( _cur  + val <      0 ) return false;
 			_cur += val;
 			break;
 		case pxtnSEEK_end:
-			if( _size + val >= _size ) return false;
+			if( _size + val >  _size ) return false;
 			if( _size + val <      0 ) return false;
 			_cur = _size + val;
 			break;
@@ -87,10 +277,10 @@ bool pxtnDescriptor::w_asfile( const void *p, int size, int num )
 {
 	bool b_ret = false;
 
-	if( !_p_desc || !_b_file || _b_read ) goto End;
-	
-	if( fwrite( p, size, num, (FILE*)_p_desc ) != num ) goto End;
-	_size += size * num;
+	if( !_p_desc || _b_read ) goto End;
+
+	if( size < 0 || num < 0 || ( num && size > INT32_MAX / num ) ) goto End;
+	if( !_w( p, size * num ) ) goto End;
 	
 	b_ret = true;
 End:
@@ -104,18 +294,31 @@ bool pxtnDescriptor::r(       void *p, int size, int num )
 
 	bool b_ret = false;
 
+	if( size < 0 || num < 0 || ( num && size > INT32_MAX / num ) ) goto End;
+
 	if( _b_file )
 	{
-		if( fread( p, size, num, (FILE*)_p_desc ) != num ) goto End;
+		int32_t bytes = size * num;
+		int32_t left  = _buf_len - _buf_pos;
+		// big reads (payloads) go straight from the file.
+		if( bytes > left && bytes > _BUFSIZE_READ )
+		{
+			memcpy( p, _p_buf + _buf_pos, left );
+			_buf_pos = _buf_len = 0;
+			if( fread( (uint8_t*)p + left, 1, bytes - left, (FILE*)_p_desc ) != (size_t)( bytes - left ) ) goto End;
+		}
+		else
+		{
+			if( bytes > left && !_buf_fill( bytes ) ) goto End;
+			memcpy( p, _p_buf + _buf_pos, bytes );
+			_buf_pos += bytes;
+		}
 	}
 	else
 	{
-		for( int  i = 0; i < num; i++ )
-		{
-			if( _cur + size > _size ) goto End;
-			memcpy( &((char*)p)[ i ], (uint8_t*)_p_desc + _cur, size );
-			_cur += size;
-		}
+		if( size * num > _size - _cur ) goto End;
+		memcpy( p, (uint8_t*)_p_desc + _cur, size * num );
+		_cur += size * num;
 	}
 	
 	b_ret = true;
@@ -145,7 +348,6 @@ int  pxtnDescriptor_v_chk( int val )
 int  pxtnDescriptor::v_w_asfile( int val, int *p_add )
 {
 	if( !_p_desc ) return 0;
-	if( !_b_file ) return 0;
 	if(  _b_read ) return 0;
 
 	uint8_t  a[ 5 ] = {0};
@@ -203,9 +405,8 @@ int  pxtnDescriptor::v_w_asfile( int val, int *p_add )
 		b[3] = (a[2]>>5) | ((a[3]<<3)&0x7F) | 0x80;
 		b[4] = (a[3]>>4) | ((a[4]<<4)&0x7F);
 	}
-	if( fwrite( b, 1, bytes, (FILE*)_p_desc )     != bytes ) return false;
+	if( !_w( b, bytes ) ) return false;
 	if( p_add ) *p_add += bytes;
-	_size += bytes;
 	return true;
 
 	return false;
@@ -217,47 +418,18 @@ bool pxtnDescriptor::v_r  ( int32_t *p  )
 	if( !_p_desc ) return false;
 	if( !_b_read ) return false;
 
-	int          i;
-	uint8_t a[ 5 ] = {0};
-	uint8_t b[ 5 ] = {0};
-
-	for( i = 0; i < 5; i++ )
+	if( _b_file )
 	{
-		if( !pxtnDescriptor::r( &a[i], 1, 1 ) ) return false;
-		if( !(a[i] & 0x80) ) break;
+		_buf_fill( 5 );
+		const uint8_t *p_src = _p_buf + _buf_pos;
+		if( !pxtnDescriptor_v_decode( &p_src, _p_buf + _buf_len, p ) ) return false;
+		_buf_pos = (int32_t)( p_src - _p_buf );
 	}
-	switch( i )
+	else
 	{
-	case 0:
-		b[0]    =  (a[0]&0x7F)>>0;
-		break;
-	case 1:
-		b[0]    = ((a[0]&0x7F)>>0) | (a[1]<<7);
-		b[1]    =  (a[1]&0x7F)>>1;
-		break;
-	case 2:
-		b[0]    = ((a[0]&0x7F)>>0) | (a[1]<<7);
-		b[1]    = ((a[1]&0x7F)>>1) | (a[2]<<6);
-		b[2]    =  (a[2]&0x7F)>>2;
-		break;
-	case 3:
-		b[0]    = ((a[0]&0x7F)>>0) | (a[1]<<7);
-		b[1]    = ((a[1]&0x7F)>>1) | (a[2]<<6);
-		b[2]    = ((a[2]&0x7F)>>2) | (a[3]<<5);
-		b[3]    =  (a[3]&0x7F)>>3;
-		break;
-	case 4:
-		b[0]    = ((a[0]&0x7F)>>0) | (a[1]<<7);
-		b[1]    = ((a[1]&0x7F)>>1) | (a[2]<<6);
-		b[2]    = ((a[2]&0x7F)>>2) | (a[3]<<5);
-		b[3]    = ((a[3]&0x7F)>>3) | (a[4]<<4);
-		b[4]    =  (a[4]&0x7F)>>4;
-		break;
-	case 5:
-		return false;
+		const uint8_t *p_src = (const uint8_t*)_p_desc + _cur;
+		if( !pxtnDescriptor_v_decode( &p_src, (const uint8_t*)_p_desc + _size, p ) ) return false;
+		_cur = (int32_t)( p_src - (const uint8_t*)_p_desc );
 	}
-
-	*p = *((int32_t*)b);
-
 	return true;
 }
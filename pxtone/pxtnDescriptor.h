@@ -29,21 +29,38 @@ private:
 	{
 		_BUFSIZE_HEEP = 1024,
 		_TAGLINE_NUM  =  128,
+		_BUFSIZE_READ = 0x10000,
+		_BUFSIZE_WRITE= 0x10000,
 	};
 	
 	void    *_p_desc;
 	bool    _b_file ;
 	bool    _b_read ;
+	bool    _b_map  ; // _p_desc is a mapping owned by this descriptor.
+	bool    _b_own  ; // _p_desc is malloc()ed by this descriptor, _cap bytes long.
 	int32_t _size   ;
 	int32_t _cur    ;
+	int32_t _cap    ;
+
+	uint8_t *_p_buf  ; // read / write buffer for files.
+	int32_t _buf_pos;
+	int32_t _buf_len;
+
+	void _release ();
+	bool _buf_fill( int32_t want );
+	bool _mem_grow( int32_t want );
+	bool _w       ( const void *p, int32_t bytes );
 	
 public:
 	
-	pxtnDescriptor();
+	 pxtnDescriptor();
+	~pxtnDescriptor();
 
-	bool set_file_r  ( FILE *fp );
-	bool set_file_w  ( FILE *fp );
-	bool set_memory_r( void *p_mem, int len );
+	bool set_file_r    ( FILE *fp );
+	bool set_file_map_r( FILE *fp ); // reads from the file mapped in memory; the file may be closed afterwards.
+	bool set_file_w    ( FILE *fp ); // buffered; flushed by w_flush() or on release, so flush or let the descriptor go before fclose().
+	bool set_memory_r  ( void *p_mem, int len );
+	bool set_memory_w  ( int32_t reserve = 0 ); // writes to memory owned by the descriptor, growing as needed.
 	bool seek        ( pxtnSEEK mode, int val );
 	
 	bool w_asfile( const void *p, int size, int num );
@@ -52,9 +69,34 @@ public:
 	int  v_w_asfile( int32_t val, int32_t *p_add );
 	bool v_r       ( int32_t *p  );
 
+	bool w_flush();
+
 	int get_size_bytes() const;
+
+	// where the next read or write happens, from the start; -1 when unset.
+	int tell() const;
+
+	// memory writers only: the bytes written, get_size_bytes() long. moves when written to.
+	const void *get_p_mem() const;
+
+	// memory descriptors only: the unread bytes, to be decoded in place and then seek()ed past.
+	const uint8_t *get_p_cur( int32_t *p_left ) const;
 };
 
 int  pxtnDescriptor_v_chk ( int val );
 
+// decodes the varint at *pp without reading at or past p_end, and moves *pp past it.
+inline bool pxtnDescriptor_v_decode( const uint8_t **pp, const uint8_t *p_end, int32_t *p_val )
+{
+	const uint8_t *p = *pp;
+	uint32_t       v = 0;
+
+	for( int i = 0; i < 5 && p < p_end; i++, p++ )
+	{
+		v |= (uint32_t)( *p & 0x7F ) << ( i * 7 );
+		if( !( *p & 0x80 ) ){ *pp = p + 1; *p_val = (int32_t)v; return true; }
+	}
+	return false;
+}
+
 #endif
@@ -9,6 +9,8 @@ static const char* _err_msg_tbl[ pxtnERR_num + 1 ] =
 
 	"anti operation"  ,
 
+	"cache stale"     ,
+
 	"deny beatclock"  ,
 	"desc w"          ,
 	"desc r"          ,
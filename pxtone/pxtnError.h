@@ -12,6 +12,8 @@ enum pxtnERR
 
 	pxtnERR_anti_opreation  ,
 
+	pxtnERR_cache_stale     ,
+
 	pxtnERR_deny_beatclock  ,
 
 	pxtnERR_desc_w          ,
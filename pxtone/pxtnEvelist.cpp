@@ -1,12 +1,18 @@
 ﻿
+#include <algorithm>
+
 #include "./pxtn.h"
 
 #include "./pxtnEvelist.h"
 
 void pxtnEvelist::Release()
 {
-	if( _eves ) free( _eves );
+	_index_drop();
+	_b_columns = false;
+	if( _eves  ) free( _eves  );
+	if( _links ) free( _links );
 	_eves              = NULL;
+	_links             = NULL;
 	_start             = NULL;
 	_eve_allocated_num =    0;
 }
@@ -14,10 +20,14 @@ void pxtnEvelist::Release()
 pxtnEvelist::pxtnEvelist()
 {
 	_eves              = NULL;
+	_links             = NULL;
 	_start             = NULL;
 	_eve_allocated_num =    0;
 	_linear            =    0;
+	_b_growable        = false;
 	_p_x4x_rec         =    0;
+	_b_indexed         = false;
+	_b_columns         = false;
 }
 
 pxtnEvelist::~pxtnEvelist()
@@ -27,20 +37,129 @@ pxtnEvelist::~pxtnEvelist()
 
 void pxtnEvelist::Clear()
 {
-	if( _eves ) memset( _eves, 0, sizeof(EVERECORD) * _eve_allocated_num );
+	_index_drop();
+	_b_columns = false;
+	if( _eves  ) memset( _eves ,    0, sizeof(EVERECORD) * _eve_allocated_num );
+	if( _links ) memset( _links, 0xff, sizeof(EVELINK  ) * _eve_allocated_num );
 	_start   = NULL;
 }
 
 
-bool pxtnEvelist::Allocate( int32_t max_event_num )
+bool pxtnEvelist::Allocate( int32_t max_event_num, bool b_growable )
 {
 	pxtnEvelist::Release();
-	if( !(  _eves = (EVERECORD*)malloc( sizeof(EVERECORD) * max_event_num ) ) ) return false;
-	memset( _eves, 0,                   sizeof(EVERECORD) * max_event_num );
+	if( !(  _eves  = (EVERECORD*)malloc( sizeof(EVERECORD) * max_event_num ) ) ) return false;
+	if( !(  _links = (EVELINK  *)malloc( sizeof(EVELINK  ) * max_event_num ) ) ){ pxtnEvelist::Release(); return false; }
+	memset( _eves ,    0,                sizeof(EVERECORD) * max_event_num );
+	memset( _links, 0xff,                sizeof(EVELINK  ) * max_event_num );
 	_eve_allocated_num = max_event_num;
+	_b_growable        = b_growable   ;
+	return true;
+}
+
+// makes room for at least num records. links are slot numbers, so only the pointers into the records move.
+bool pxtnEvelist::_grow( int32_t num )
+{
+	if( num <= _eve_allocated_num ) return true;
+	if( !_b_growable || !_eves    ) return false;
+
+	int32_t new_num = _eve_allocated_num * 2;
+	if( new_num < num ) new_num = num;
+
+	EVERECORD* p_new   = (EVERECORD*)malloc( sizeof(EVERECORD) * new_num );
+	EVELINK  * p_links = (EVELINK  *)malloc( sizeof(EVELINK  ) * new_num );
+	if( !p_new || !p_links ){ if( p_new ) free( p_new ); if( p_links ) free( p_links ); return false; }
+	memcpy( p_new  , _eves , sizeof(EVERECORD) * _eve_allocated_num );
+	memcpy( p_links, _links, sizeof(EVELINK  ) * _eve_allocated_num );
+	memset( &p_new  [ _eve_allocated_num ],    0, sizeof(EVERECORD) * ( new_num - _eve_allocated_num ) );
+	memset( &p_links[ _eve_allocated_num ], 0xff, sizeof(EVELINK  ) * ( new_num - _eve_allocated_num ) );
+
+	if( _start     ) _start     = p_new + ( _start     - _eves );
+	if( _p_x4x_rec ) _p_x4x_rec = p_new + ( _p_x4x_rec - _eves );
+
+	if( _b_indexed ){ for( int32_t r = _eve_allocated_num; r < new_num; r++ ) _free.push( r ); }
+
+	free( _eves  );
+	free( _links );
+	_eves              = p_new  ;
+	_links             = p_links;
+	_eve_allocated_num = new_num;
 	return true;
 }
 
+static uint64_t _tail_key( uint8_t unit_no, uint8_t kind, int32_t clock )
+{
+	return ( (uint64_t)unit_no << 40 ) | ( (uint64_t)kind << 32 ) | ( (uint32_t)clock ^ 0x80000000u );
+}
+
+static bool _tail_key_same_event( uint64_t key1, uint64_t key2 )
+{
+	return ( key1 >> 32 ) == ( key2 >> 32 );
+}
+
+void pxtnEvelist::_index_build()
+{
+	_index_drop();
+	for( const EVERECORD* p = _start; p; p = _next( p ) )
+	{
+		int32_t r = (int32_t)( p - _eves );
+		const EVERECORD* p_prev = _prev( p );
+		if( !p_prev || p_prev->clock != p->clock ) _clock_index.emplace_hint( _clock_index.end(), p->clock, r );
+		if( Evelist_Kind_IsTail( p->kind ) ) _tail_index[ _tail_key( p->unit_no, p->kind, p->clock ) ] = r;
+	}
+	for( int32_t r = 0; r < _eve_allocated_num; r++ )
+	{
+		if( _eves[ r ].kind == EVENTKIND_NULL ) _free.push( r );
+	}
+	_b_indexed = true;
+}
+
+void pxtnEvelist::_index_drop()
+{
+	if( !_b_indexed ) return;
+	_free        = decltype( _free )();
+	_clock_index.clear();
+	_tail_index .clear();
+	_b_indexed   = false;
+}
+
+void pxtnEvelist::_columns_build() const
+{
+	int32_t unit_num = 0;
+	for( const EVERECORD* p = _start; p; p = _next( p ) ){ if( p->unit_no >= unit_num ) unit_num = p->unit_no + 1; }
+
+	for( size_t c = 0; c < _columns  .size(); c++ ){ _columns[ c ].clocks.clear(); _columns[ c ].values.clear(); }
+	for( size_t u = 0; u < _unit_recs.size(); u++ ) _unit_recs[ u ].clear();
+	_columns  .resize( unit_num * EVENTKIND_NUM );
+	_unit_recs.resize( unit_num                 );
+
+	for( const EVERECORD* p = _start; p; p = _next( p ) )
+	{
+		_unit_recs[ p->unit_no ].push_back( (int32_t)( p - _eves ) );
+		if( p->kind >= EVENTKIND_NUM ) continue;
+		_COLUMN& col = _columns[ p->unit_no * EVENTKIND_NUM + p->kind ];
+		col.clocks.push_back( p->clock );
+		col.values.push_back( p->value );
+	}
+	_b_columns = true;
+}
+
+const pxtnEvelist::_COLUMN* pxtnEvelist::_column( uint8_t unit_no, uint8_t kind ) const
+{
+	if( !_eves || kind >= EVENTKIND_NUM ) return NULL;
+	if( !_b_columns ) _columns_build();
+	if( unit_no >= (int32_t)_unit_recs.size() ) return NULL;
+	return &_columns[ unit_no * EVENTKIND_NUM + kind ];
+}
+
+const std::vector<int32_t>* pxtnEvelist::_unit_records( uint8_t unit_no ) const
+{
+	if( !_eves ) return NULL;
+	if( !_b_columns ) _columns_build();
+	if( unit_no >= (int32_t)_unit_recs.size() ) return NULL;
+	return &_unit_recs[ unit_no ];
+}
+
 int32_t  pxtnEvelist::get_Num_Max() const
 {
 	if( !_eves ) return 0;
@@ -52,7 +171,7 @@ int32_t  pxtnEvelist::get_Max_Clock() const
 	int32_t max_clock = 0;
 	int32_t clock;
 
-	for( EVERECORD* p = _start; p; p = p->next )
+	for( EVERECORD* p = _start; p; p = _next( p ) )
 	{
 		if( Evelist_Kind_IsTail( p->kind ) ) clock = p->clock + p->value;
 		else                                 clock = p->clock           ;
@@ -68,7 +187,7 @@ int32_t  pxtnEvelist::get_Count() const
 	if( !_eves || !_start ) return 0;
 
 	int32_t    count = 0;
-	for( EVERECORD* p = _start; p; p = p->next ) count++;
+	for( EVERECORD* p = _start; p; p = _next( p ) ) count++;
 	return count;
 }
 
@@ -77,47 +196,56 @@ int32_t  pxtnEvelist::get_Count( uint8_t kind, int32_t value ) const
 	if( !_eves ) return 0;
 
 	int32_t count = 0;
-	for( EVERECORD* p = _start; p; p = p->next ){ if( p->kind == kind && p->value == value ) count++; }
+	for( EVERECORD* p = _start; p; p = _next( p ) ){ if( p->kind == kind && p->value == value ) count++; }
 	return count;
 }
 
 int32_t  pxtnEvelist::get_Count( uint8_t unit_no ) const
 {
-	if( !_eves ) return 0;
-
-	int32_t count = 0;
-	for( EVERECORD* p = _start; p; p = p->next ){ if( p->unit_no == unit_no ) count++; }
-	return count;
+	const std::vector<int32_t>* p_recs = _unit_records( unit_no );
+	if( !p_recs ) return 0;
+	return (int32_t)p_recs->size();
 }
 
 int32_t  pxtnEvelist::get_Count( uint8_t unit_no, uint8_t kind ) const
 {
-	if( !_eves ) return 0;
-
-	int32_t count = 0;
-	for( EVERECORD* p = _start; p; p = p->next ){ if( p->unit_no == unit_no && p->kind == kind ) count++; }
-	return count;
+	const _COLUMN* p_col = _column( unit_no, kind );
+	if( !p_col ) return 0;
+	return (int32_t)p_col->clocks.size();
 }
 
 int32_t  pxtnEvelist::get_Count( int32_t clock1, int32_t clock2, uint8_t unit_no ) const
 {
-	if( !_eves ) return 0;
+	const std::vector<int32_t>* p_recs = _unit_records( unit_no );
+	if( !p_recs ) return 0;
+
+	size_t r = 0;
+	for( ; r < p_recs->size(); r++ )
+	{
+		const EVERECORD* p = &_eves[ (*p_recs)[ r ] ];
+		if(                                   p->clock            >= clock1 ) break;
+		if( Evelist_Kind_IsTail( p->kind ) && p->clock + p->value >  clock1 ) break;
+	}
+
+	int32_t count = 0;
 
-	EVERECORD* p;
-	for( p = _start; p; p = p->next )
+	// reversed, the range ends at an event of any unit, as the list walk always did.
+	if( clock2 < clock1 )
 	{
-		if( p->unit_no == unit_no )
+		if( r == p_recs->size() ) return 0;
+		for( const EVERECORD* p = &_eves[ (*p_recs)[ r ] ]; p; p = _next( p ) )
 		{
-			if(                                   p->clock            >= clock1 ) break;
-			if( Evelist_Kind_IsTail( p->kind ) && p->clock + p->value >  clock1 ) break;
+			if( p->clock != clock1 && p->clock >= clock2 ) break;
+			if( p->unit_no == unit_no ) count++;
 		}
+		return count;
 	}
 
-	int32_t count = 0;
-	for(           ; p; p = p->next )
+	for( ; r < p_recs->size(); r++ )
 	{
+		const EVERECORD* p = &_eves[ (*p_recs)[ r ] ];
 		if( p->clock != clock1 && p->clock >= clock2 ) break;
-		if( p->unit_no == unit_no ) count++;
+		count++;
 	}
 	return count;
 }
@@ -155,16 +283,13 @@ int32_t pxtnEvelist::get_Value( int32_t clock, uint8_t unit_no, uint8_t kind ) c
 {
 	if( !_eves ) return 0;
 
-	EVERECORD* p;
-	int32_t val = _DefaultKindValue( kind );
-
-	for( p = _start; p; p = p->next )
-	{
-		if( p->clock > clock ) break;
-		if( p->unit_no == unit_no && p->kind == kind ) val = p->value;
-	}
+	const _COLUMN* p_col = _column( unit_no, kind );
+	if( !p_col ) return _DefaultKindValue( kind );
 
-	return val;
+	// the last event at or before the clock.
+	size_t i = std::upper_bound( p_col->clocks.begin(), p_col->clocks.end(), clock ) - p_col->clocks.begin();
+	if( !i ) return _DefaultKindValue( kind );
+	return p_col->values[ i - 1 ];
 }
 
 const EVERECORD* pxtnEvelist::get_Records() const
@@ -173,22 +298,40 @@ const EVERECORD* pxtnEvelist::get_Records() const
 	return _start;
 }
 
+int32_t pxtnEvelist::get_Column( uint8_t unit_no, uint8_t kind, const int32_t** pp_clocks, const int32_t** pp_values ) const
+{
+	const _COLUMN* p_col = _column( unit_no, kind );
+	if( !p_col || p_col->clocks.empty() ){ *pp_clocks = NULL; *pp_values = NULL; return 0; }
+	*pp_clocks = &p_col->clocks[ 0 ];
+	*pp_values = &p_col->values[ 0 ];
+	return (int32_t)p_col->clocks.size();
+}
+
 
 void pxtnEvelist::_rec_set( EVERECORD* p_rec, EVERECORD* prev, EVERECORD* next, int32_t clock, uint8_t unit_no, uint8_t kind, int32_t value )
 {
-	if( prev ) prev->next = p_rec;
-	else       _start     = p_rec;
-	if( next ) next->prev = p_rec;
+	int32_t r = _slot( p_rec );
 
-	p_rec->next    = next   ;
-	p_rec->prev    = prev   ;
+	if( prev ) _links[ _slot( prev ) ].next = r    ;
+	else       _start                       = p_rec;
+	if( next ) _links[ _slot( next ) ].prev = r    ;
+
+	_links[ r ].next = _slot( next );
+	_links[ r ].prev = _slot( prev );
 	p_rec->clock   = clock  ;
 	p_rec->kind    = kind   ;
 	p_rec->unit_no = unit_no;
 	p_rec->value   = value  ;
+	_b_columns     = false  ;
+
+	if( _b_indexed )
+	{
+		if( !prev || prev->clock != clock ) _clock_index[ clock ] = r;
+		if( Evelist_Kind_IsTail( kind ) ) _tail_index[ _tail_key( unit_no, kind, clock ) ] = r;
+	}
 }
 
-static int32_t _ComparePriority( uint8_t kind1, uint8_t kind2 )
+static int32_t _KindPriority( uint8_t kind )
 {
 	static const int32_t priority_table[ EVENTKIND_NUM ] =
 	{
@@ -210,14 +353,38 @@ static int32_t _ComparePriority( uint8_t kind1, uint8_t kind2 )
 		100, // EVENTKIND_PAN_TIME  
 	};
 
-	return priority_table[ kind1 ] - priority_table[ kind2 ];
+	return priority_table[ kind ];
+}
+
+static int32_t _ComparePriority( uint8_t kind1, uint8_t kind2 )
+{
+	return _KindPriority( kind1 ) - _KindPriority( kind2 );
 }
 
 void pxtnEvelist::_rec_cut( EVERECORD* p_rec )
 {
-	if( p_rec->prev ) p_rec->prev->next = p_rec->next;
-	else              _start            = p_rec->next;
-	if( p_rec->next ) p_rec->next->prev = p_rec->prev;
+	_b_columns = false;
+	if( _b_indexed )
+	{
+		int32_t r = (int32_t)( p_rec - _eves );
+		std::map<int32_t,int32_t>::iterator it = _clock_index.find( p_rec->clock );
+		if( it != _clock_index.end() && it->second == r )
+		{
+			const EVERECORD* p_next = _next( p_rec );
+			if( p_next && p_next->clock == p_rec->clock ) it->second = _slot( p_next );
+			else                                          _clock_index.erase( it );
+		}
+		if( Evelist_Kind_IsTail( p_rec->kind ) )
+		{
+			std::map<uint64_t,int32_t>::iterator t = _tail_index.find( _tail_key( p_rec->unit_no, p_rec->kind, p_rec->clock ) );
+			if( t != _tail_index.end() && t->second == r ) _tail_index.erase( t );
+		}
+		_free.push( r );
+	}
+	const EVELINK& link = _links[ _slot( p_rec ) ];
+	if( link.prev >= 0 ) _links[ link.prev ].next = link.next    ;
+	else                 _start                   = _next( p_rec );
+	if( link.next >= 0 ) _links[ link.next ].prev = link.prev    ;
 	p_rec->kind = EVENTKIND_NULL;
 }
 
@@ -235,67 +402,65 @@ bool pxtnEvelist::Record_Add_i( int32_t clock, uint8_t unit_no, uint8_t kind, in
 	EVERECORD* p_prev = NULL;
 	EVERECORD* p_next = NULL;
 
+	if( !_b_indexed ) _index_build();
+
 	// 空き検索
-	for( int32_t r = 0; r < _eve_allocated_num; r++ )
-	{
-		if( _eves[ r ].kind == EVENTKIND_NULL ){ p_new = &_eves[ r ]; break; }
-	}
-	if( !p_new ) return false;
+	if( _free.empty() && !_grow( _eve_allocated_num + 1 ) ) return false;
+	p_new = &_eves[ _free.top() ]; _free.pop();
 
-	// first.
-	if( !_start )
+	std::map<int32_t,int32_t>::iterator it = _clock_index.lower_bound( clock );
+
+	// 末端
+	if( it == _clock_index.end() )
 	{
+		if( !_clock_index.empty() )
+		{
+			for( p_prev = &_eves[ _clock_index.rbegin()->second ]; _next( p_prev ); p_prev = _next( p_prev ) ){}
+		}
 	}
-	// top.
-	else if( clock < _start->clock )
+	// 同時
+	else if( it->first == clock )
 	{
-		p_next = _start;
+		for( EVERECORD* p = &_eves[ it->second ]; true; p = _next( p ) )
+		{
+			if( p->clock != clock                        ){ p_prev = _prev( p ); p_next = p; break; } 
+			if( unit_no == p->unit_no && kind == p->kind ){ p_prev = _prev( p ); p_next = _next( p ); _rec_cut( p ); break; } // 置き換え
+			if( _ComparePriority( kind, p->kind ) < 0    ){ p_prev = _prev( p ); p_next = p; break; }// プライオリティを検査
+			if( !_next( p )                              ){ p_prev = p; break; }// 末端
+		}
 	}
+	// 追い越した
 	else
 	{
-
-		for( EVERECORD* p = _start; p; p = p->next )
-		{
-			if( p->clock == clock ) // 同時
-			{
-				for( ; true; p = p->next )
-				{
-					if( p->clock != clock                        ){ p_prev = p->prev; p_next = p; break; } 
-					if( unit_no == p->unit_no && kind == p->kind ){ p_prev = p->prev; p_next = p->next; p->kind = EVENTKIND_NULL; break; } // 置き換え
-					if( _ComparePriority( kind, p->kind ) < 0    ){ p_prev = p->prev; p_next = p; break; }// プライオリティを検査
-					if( !p->next                                 ){ p_prev = p; break; }// 末端
-				}
-				break;
-			}
-			else if( p->clock > clock ){ p_prev = p->prev; p_next = p      ; break; } // 追い越した
-			else if( !p->next         ){ p_prev = p; break; }// 末端
-		}
+		p_next = &_eves[ it->second ];
+		p_prev = _prev( p_next );
 	}
 
 	_rec_set( p_new, p_prev, p_next, clock, unit_no, kind, value );
 
-	// cut prev tail
 	if( Evelist_Kind_IsTail( kind ) )
 	{
-		for( EVERECORD* p = p_new->prev; p; p = p->prev )
+		uint64_t key = _tail_key( unit_no, kind, clock );
+		std::map<uint64_t,int32_t>::iterator t = _tail_index.find( key );
+
+		// cut prev tail
+		if( t != _tail_index.begin() )
 		{
-			if( p->unit_no == unit_no && p->kind == kind )
+			std::map<uint64_t,int32_t>::iterator t_prev = std::prev( t );
+			if( _tail_key_same_event( t_prev->first, key ) )
 			{
+				EVERECORD* p = &_eves[ t_prev->second ];
 				if( clock < p->clock + p->value ) p->value = clock - p->clock;
-				break;
 			}
 		}
-	}
 
-	// delete next
-	if( Evelist_Kind_IsTail( kind ) )
-	{
-		for( EVERECORD* p = p_new->next; p && p->clock < clock + value; p = p->next )
+		// delete next
+		for( ++t; t != _tail_index.end() && _tail_key_same_event( t->first, key ); )
 		{
-			if( p->unit_no == unit_no && p->kind == kind )
-			{
-				_rec_cut( p );
-			}
+			EVERECORD* p = &_eves[ t->second ];
+			if( p->clock >= clock + value ) break;
+			++t;
+			_rec_cut( p );
 		}
 	}
 
@@ -306,9 +471,11 @@ int32_t pxtnEvelist::Record_Delete( int32_t clock1, int32_t clock2, uint8_t unit
 {
 	if( !_eves  ) return 0;
 
+	_b_columns = false;
+
 	int32_t count = 0;
 
-	for( EVERECORD* p = _start; p; p = p->next )
+	for( EVERECORD* p = _start; p; p = _next( p ) )
 	{
 		if( p->clock != clock1 && p->clock >= clock2 ) break;
 		if( p->clock >= clock1 && p->unit_no == unit_no && p->kind == kind ){ _rec_cut( p ); count++; }
@@ -316,7 +483,7 @@ int32_t pxtnEvelist::Record_Delete( int32_t clock1, int32_t clock2, uint8_t unit
 
 	if( Evelist_Kind_IsTail( kind ) )
 	{
-		for( EVERECORD* p = _start; p; p = p->next )
+		for( EVERECORD* p = _start; p; p = _next( p ) )
 		{
 			if( p->clock >= clock1 ) break;
 			if( p->unit_no == unit_no && p->kind == kind && p->clock + p->value > clock1 )
@@ -334,15 +501,17 @@ int32_t pxtnEvelist::Record_Delete( int32_t clock1, int32_t clock2, uint8_t unit
 {
 	if( !_eves  ) return 0;
 
+	_b_columns = false;
+
 	int32_t count = 0;
 
-	for( EVERECORD* p = _start; p; p = p->next )
+	for( EVERECORD* p = _start; p; p = _next( p ) )
 	{
 		if( p->clock != clock1 && p->clock >= clock2 ) break;
 		if( p->clock >= clock1 && p->unit_no == unit_no ){ _rec_cut( p ); count++; }
 	}
 
-	for( EVERECORD* p = _start; p; p = p->next )
+	for( EVERECORD* p = _start; p; p = _next( p ) )
 	{
 		if( p->clock >= clock1 ) break;
 		if( p->unit_no == unit_no && Evelist_Kind_IsTail( p->kind ) && p->clock + p->value > clock1 )
@@ -360,9 +529,12 @@ int32_t pxtnEvelist::Record_UnitNo_Miss( uint8_t unit_no )
 {
 	if( !_eves  ) return 0;
 
+	_index_drop();
+	_b_columns = false;
+
 	int32_t count = 0;
 
-	for( EVERECORD* p = _start; p; p = p->next )
+	for( EVERECORD* p = _start; p; p = _next( p ) )
 	{
 		if(      p->unit_no == unit_no ){ _rec_cut( p ); count++; }
 		else if( p->unit_no >  unit_no ){ p->unit_no--;    count++; }
@@ -374,8 +546,11 @@ int32_t pxtnEvelist::Record_UnitNo_Set( uint8_t unit_no )
 {
 	if( !_eves  ) return 0;
 
+	_index_drop();
+	_b_columns = false;
+
 	int32_t count = 0;
-	for( EVERECORD* p = _start; p; p = p->next ){ p->unit_no = unit_no; count++; }
+	for( EVERECORD* p = _start; p; p = _next( p ) ){ p->unit_no = unit_no; count++; }
 	return count;
 }
 
@@ -386,9 +561,11 @@ int32_t pxtnEvelist::Record_UnitNo_Replace( uint8_t old_u, uint8_t new_u )
 	int32_t count = 0;
 	
 	if( old_u == new_u ) return 0;
+	_index_drop();
+	_b_columns = false;
 	if( old_u <  new_u )
 	{
-		for( EVERECORD* p = _start; p; p = p->next )
+		for( EVERECORD* p = _start; p; p = _next( p ) )
 		{
 			if(      p->unit_no == old_u                        ){ p->unit_no = new_u; count++; }
 			else if( p->unit_no >  old_u && p->unit_no <= new_u ){ p->unit_no--;       count++; }
@@ -396,7 +573,7 @@ int32_t pxtnEvelist::Record_UnitNo_Replace( uint8_t old_u, uint8_t new_u )
 	}
 	else
 	{
-		for( EVERECORD* p = _start; p; p = p->next )
+		for( EVERECORD* p = _start; p; p = _next( p ) )
 		{
 			if(      p->unit_no == old_u                        ){ p->unit_no = new_u; count++; }
 			else if( p->unit_no <  old_u && p->unit_no >= new_u ){ p->unit_no++;       count++; }
@@ -411,9 +588,11 @@ int32_t pxtnEvelist::Record_Value_Set( int32_t clock1, int32_t clock2, uint8_t u
 {
 	if( !_eves  ) return 0;
 
+	_b_columns = false;
+
 	int32_t count = 0;
 
-	for( EVERECORD* p = _start; p; p = p->next )
+	for( EVERECORD* p = _start; p; p = _next( p ) )
 	{
 		if( p->unit_no == unit_no && p->kind == kind && p->clock >= clock1 && p->clock < clock2 )
 		{
@@ -429,9 +608,12 @@ int32_t  pxtnEvelist::BeatClockOperation( int32_t rate )
 {
 	if( !_eves  ) return 0;
 
+	_index_drop();
+	_b_columns = false;
+
 	int32_t count = 0;
 
-	for( EVERECORD* p = _start; p; p = p->next )
+	for( EVERECORD* p = _start; p; p = _next( p ) )
 	{
 		p->clock *= rate;
 		if( Evelist_Kind_IsTail( p->kind ) ) p->value *= rate;
@@ -442,12 +624,8 @@ int32_t  pxtnEvelist::BeatClockOperation( int32_t rate )
 }
 
 
-int32_t pxtnEvelist::Record_Value_Change( int32_t clock1, int32_t clock2, uint8_t unit_no, uint8_t kind, int32_t value )
+static void _ValueChangeRange( uint8_t kind, int32_t* p_max, int32_t* p_min )
 {
-	if( !_eves  ) return 0;
-
-	int32_t count = 0;
-
 	int32_t max, min;
 
 	switch( kind )
@@ -461,8 +639,23 @@ int32_t pxtnEvelist::Record_Value_Change( int32_t clock1, int32_t clock2, uint8_
 	case EVENTKIND_VOLUME    : max =   0x80; min =   0; break;
 	default: max = 0; min = 0;
 	}
+	*p_max = max;
+	*p_min = min;
+}
+
+int32_t pxtnEvelist::Record_Value_Change( int32_t clock1, int32_t clock2, uint8_t unit_no, uint8_t kind, int32_t value )
+{
+	if( !_eves  ) return 0;
+
+	_b_columns = false;
 
-	for( EVERECORD* p = _start; p; p = p->next )
+	int32_t count = 0;
+
+	int32_t max, min;
+
+	_ValueChangeRange( kind, &max, &min );
+
+	for( EVERECORD* p = _start; p; p = _next( p ) )
 	{
 		if( p->unit_no == unit_no && p->kind == kind && p->clock >= clock1 )
 		{
@@ -483,9 +676,11 @@ int32_t pxtnEvelist::Record_Value_Omit( uint8_t kind, int32_t value )
 {
 	if( !_eves  ) return 0;
 
+	_b_columns = false;
+
 	int32_t count = 0;
 	
-	for( EVERECORD* p = _start; p; p = p->next )
+	for( EVERECORD* p = _start; p; p = _next( p ) )
 	{
 		if( p->kind == kind )
 		{
@@ -501,12 +696,14 @@ int32_t pxtnEvelist::Record_Value_Replace( uint8_t kind, int32_t old_value, int3
 {
 	if( !_eves  ) return 0;
 
+	_b_columns = false;
+
 	int32_t count = 0;
 	
 	if( old_value == new_value ) return 0;
 	if( old_value <  new_value )
 	{
-		for( EVERECORD* p = _start; p; p = p->next )
+		for( EVERECORD* p = _start; p; p = _next( p ) )
 		{
 			if( p->kind == kind )
 			{
@@ -517,7 +714,7 @@ int32_t pxtnEvelist::Record_Value_Replace( uint8_t kind, int32_t old_value, int3
 	}
 	else
 	{
-		for( EVERECORD* p = _start; p; p = p->next )
+		for( EVERECORD* p = _start; p; p = _next( p ) )
 		{
 			if( p->kind == kind )
 			{
@@ -548,7 +745,7 @@ int32_t pxtnEvelist::Record_Clock_Shift( int32_t clock, int32_t shift, uint8_t u
 
 	if( shift < 0 )
 	{
-		for( ; p; p = p->next ){ if( p->clock >= clock ) break; }
+		for( ; p; p = _next( p ) ){ if( p->clock >= clock ) break; }
 		while( p )
 		{
 			if( p->unit_no == unit_no )
@@ -556,7 +753,7 @@ int32_t pxtnEvelist::Record_Clock_Shift( int32_t clock, int32_t shift, uint8_t u
 				c      = p->clock + shift;
 				k      = p->kind         ;
 				v      = p->value        ;
-				p_next = p->next;
+				p_next = _next( p );
 
 				_rec_cut( p );
 				if( c >= 0 ) Record_Add_i( c, unit_no, k, v );
@@ -566,13 +763,13 @@ int32_t pxtnEvelist::Record_Clock_Shift( int32_t clock, int32_t shift, uint8_t u
 			}
 			else
 			{
-				p = p->next;
+				p = _next( p );
 			}
 		}
 	}
 	else if( shift > 0 )
 	{
-		while( p->next ) p = p->next;
+		while( _next( p ) ) p = _next( p );
 		while( p )
 		{
 			if( p->clock < clock ) break;
@@ -582,7 +779,7 @@ int32_t pxtnEvelist::Record_Clock_Shift( int32_t clock, int32_t shift, uint8_t u
 				c      = p->clock + shift;
 				k      = p->kind         ;
 				v      = p->value        ;
-				p_prev = p->prev;
+				p_prev = _prev( p );
 
 				_rec_cut( p );
 				Record_Add_i( c, unit_no, k, v );
@@ -592,13 +789,442 @@ int32_t pxtnEvelist::Record_Clock_Shift( int32_t clock, int32_t shift, uint8_t u
 			}
 			else
 			{
-				p = p->prev;
+				p = _prev( p );
 			}
 		}
 	}
 	return count;
 }
 
+/////////////////////
+// edit transaction
+/////////////////////
+
+enum
+{
+	_EDIT_CLOCK_SHIFT = 0,
+	_EDIT_VALUE_SET      ,
+	_EDIT_VALUE_CHANGE   ,
+	_EDIT_DELETE_KIND    ,
+	_EDIT_DELETE_UNIT    ,
+	_EDIT_UNITNO_REPLACE ,
+};
+
+typedef struct
+{
+	EVERECORD rec   ;
+	int32_t   stamp ; // orders records of the same clock and priority, as their place in the list would.
+	bool      b_dead;
+}
+_EDITREC;
+
+// list order: by clock, then priority, then which got there first.
+static bool _edit_Order( const _EDITREC& a, const _EDITREC& b )
+{
+	if( a.rec.clock != b.rec.clock ) return a.rec.clock < b.rec.clock;
+	int32_t pri = _ComparePriority( a.rec.kind, b.rec.kind );
+	if( pri ) return pri < 0;
+	return a.stamp < b.stamp;
+}
+
+// Record_Delete() on the flat records.
+static void _edit_Delete( std::vector<_EDITREC>& recs, int32_t clock1, int32_t clock2, uint8_t unit_no, bool b_kind, uint8_t kind )
+{
+	// the list walk stops at the first record past clock2 that isn't at clock1,
+	// so with clock2 at or before clock1 anything in between saves clock1 too.
+	bool b_blocked = false;
+	if( clock2 <= clock1 )
+	{
+		for( size_t r = 0; r < recs.size(); r++ )
+		{
+			if( !recs[ r ].b_dead && recs[ r ].rec.clock >= clock2 && recs[ r ].rec.clock < clock1 ){ b_blocked = true; break; }
+		}
+	}
+
+	for( size_t r = 0; r < recs.size(); r++ )
+	{
+		if( recs[ r ].b_dead ) continue;
+		EVERECORD* p = &recs[ r ].rec;
+		if( p->unit_no != unit_no ) continue;
+		if( b_kind && p->kind != kind ) continue;
+
+		if( p->clock >= clock1 )
+		{
+			if( clock2 > clock1 ? p->clock < clock2 : ( !b_blocked && p->clock == clock1 ) ) recs[ r ].b_dead = true;
+		}
+		else if( Evelist_Kind_IsTail( p->kind ) && p->clock + p->value > clock1 )
+		{
+			p->value = clock1 - p->clock;
+		}
+	}
+}
+
+// Record_Clock_Shift() on the flat records: the unit's records from the clock on are taken
+// out and added back one by one, in the same order and under the same rules as Record_Add_i().
+static void _edit_Clock_Shift( std::vector<_EDITREC>& recs, int32_t clock, int32_t shift, uint8_t unit_no, int32_t* p_stamp )
+{
+	std::vector<int32_t>      moves;
+	std::map<int32_t,int32_t> chains[ EVENTKIND_NUM ]; // the unit's records by kind and clock
+
+	for( size_t r = 0; r < recs.size(); r++ )
+	{
+		const EVERECORD* p = &recs[ r ].rec;
+		if( recs[ r ].b_dead || p->unit_no != unit_no || p->kind >= EVENTKIND_NUM ) continue;
+		chains[ p->kind ][ p->clock ] = (int32_t)r;
+		if( p->clock >= clock ) moves.push_back( (int32_t)r );
+	}
+
+	std::sort( moves.begin(), moves.end(), [ &recs ]( int32_t a, int32_t b ){ return _edit_Order( recs[ a ], recs[ b ] ); } );
+	if( shift > 0 ) std::reverse( moves.begin(), moves.end() );
+
+	for( size_t m = 0; m < moves.size(); m++ )
+	{
+		int32_t    r  = moves[ m ];
+		_EDITREC&  er = recs[ r ];
+		EVERECORD* p  = &er.rec;
+		if( er.b_dead ) continue;
+
+		std::map<int32_t,int32_t>& chain = chains[ p->kind ];
+		chain.erase( p->clock );
+
+		int32_t c = p->clock + shift;
+		if( shift < 0 && c < 0 ){ er.b_dead = true; continue; }
+		p->clock = c;
+
+		// 置き換え
+		std::map<int32_t,int32_t>::iterator it = chain.find( c );
+		if( it != chain.end() )
+		{
+			recs[ it->second ].b_dead = true;
+			er.stamp   = recs[ it->second ].stamp;
+			it->second = r;
+		}
+		else
+		{
+			er.stamp = (*p_stamp)++;
+			it = chain.emplace( c, r ).first;
+		}
+
+		if( !Evelist_Kind_IsTail( p->kind ) ) continue;
+
+		// cut prev tail
+		if( it != chain.begin() )
+		{
+			EVERECORD* p_prev = &recs[ std::prev( it )->second ].rec;
+			if( c < p_prev->clock + p_prev->value ) p_prev->value = c - p_prev->clock;
+		}
+
+		// delete next
+		for( std::map<int32_t,int32_t>::iterator n = std::next( it ); n != chain.end() && n->first < c + p->value; )
+		{
+			recs[ n->second ].b_dead = true;
+			n = chain.erase( n );
+		}
+	}
+}
+
+void pxtnEvelist::_edit_push( int32_t type, int32_t clock1, int32_t clock2, int32_t value, uint8_t unit_no, uint8_t kind )
+{
+	_EDITOP op;
+	op.type    = type   ;
+	op.clock1  = clock1 ;
+	op.clock2  = clock2 ;
+	op.value   = value  ;
+	op.unit_no = unit_no;
+	op.kind    = kind   ;
+	_edits.push_back( op );
+}
+
+void pxtnEvelist::Edit_Clock_Shift( int32_t clock, int32_t shift, uint8_t unit_no )
+{
+	_edit_push( _EDIT_CLOCK_SHIFT, clock, 0, shift, unit_no, EVENTKIND_NULL );
+}
+
+void pxtnEvelist::Edit_Value_Set( int32_t clock1, int32_t clock2, uint8_t unit_no, uint8_t kind, int32_t value )
+{
+	_edit_push( _EDIT_VALUE_SET, clock1, clock2, value, unit_no, kind );
+}
+
+void pxtnEvelist::Edit_Value_Change( int32_t clock1, int32_t clock2, uint8_t unit_no, uint8_t kind, int32_t value )
+{
+	_edit_push( _EDIT_VALUE_CHANGE, clock1, clock2, value, unit_no, kind );
+}
+
+void pxtnEvelist::Edit_Delete( int32_t clock1, int32_t clock2, uint8_t unit_no, uint8_t kind )
+{
+	_edit_push( _EDIT_DELETE_KIND, clock1, clock2, 0, unit_no, kind );
+}
+
+void pxtnEvelist::Edit_Delete( int32_t clock1, int32_t clock2, uint8_t unit_no )
+{
+	_edit_push( _EDIT_DELETE_UNIT, clock1, clock2, 0, unit_no, EVENTKIND_NULL );
+}
+
+void pxtnEvelist::Edit_UnitNo_Replace( uint8_t old_u, uint8_t new_u )
+{
+	_edit_push( _EDIT_UNITNO_REPLACE, 0, 0, new_u, old_u, EVENTKIND_NULL );
+}
+
+void pxtnEvelist::Edit_Cancel()
+{
+	_edits.clear();
+}
+
+bool pxtnEvelist::Edit_Commit()
+{
+	if( !_eves ){ _edits.clear(); return false; }
+	if( _edits.empty() ) return true;
+
+	std::vector<_EDITREC> recs;
+	recs.reserve( get_Count() );
+	for( const EVERECORD* p = _start; p; p = _next( p ) )
+	{
+		_EDITREC er;
+		er.rec    = *p;
+		er.stamp  = (int32_t)recs.size();
+		er.b_dead = false;
+		recs.push_back( er );
+	}
+
+	int32_t stamp   = (int32_t)recs.size();
+	bool    b_moved = false;
+
+	for( size_t e = 0; e < _edits.size(); e++ )
+	{
+		const _EDITOP& op = _edits[ e ];
+		switch( op.type )
+		{
+		case _EDIT_CLOCK_SHIFT:
+			if( !op.value ) break;
+			_edit_Clock_Shift( recs, op.clock1, op.value, op.unit_no, &stamp );
+			b_moved = true;
+			break;
+
+		case _EDIT_VALUE_SET:
+			for( size_t r = 0; r < recs.size(); r++ )
+			{
+				EVERECORD* p = &recs[ r ].rec;
+				if( !recs[ r ].b_dead && p->unit_no == op.unit_no && p->kind == op.kind && p->clock >= op.clock1 && p->clock < op.clock2 ) p->value = op.value;
+			}
+			break;
+
+		case _EDIT_VALUE_CHANGE:
+			{
+				int32_t max, min;
+				_ValueChangeRange( op.kind, &max, &min );
+				for( size_t r = 0; r < recs.size(); r++ )
+				{
+					EVERECORD* p = &recs[ r ].rec;
+					if( recs[ r ].b_dead || p->unit_no != op.unit_no || p->kind != op.kind || p->clock < op.clock1 ) continue;
+					if( op.clock2 != -1 && p->clock >= op.clock2 ) continue;
+					p->value += op.value;
+					if( p->value < min ) p->value = min;
+					if( p->value > max ) p->value = max;
+				}
+			}
+			break;
+
+		case _EDIT_DELETE_KIND: _edit_Delete( recs, op.clock1, op.clock2, op.unit_no, true , op.kind         ); break;
+		case _EDIT_DELETE_UNIT: _edit_Delete( recs, op.clock1, op.clock2, op.unit_no, false, EVENTKIND_NULL ); break;
+
+		case _EDIT_UNITNO_REPLACE:
+			{
+				uint8_t old_u = op.unit_no, new_u = (uint8_t)op.value;
+				if( old_u == new_u ) break;
+				for( size_t r = 0; r < recs.size(); r++ )
+				{
+					EVERECORD* p = &recs[ r ].rec;
+					if(      p->unit_no == old_u                                           ) p->unit_no = new_u;
+					else if( old_u < new_u && p->unit_no >  old_u && p->unit_no <= new_u ) p->unit_no--;
+					else if( old_u > new_u && p->unit_no <  old_u && p->unit_no >= new_u ) p->unit_no++;
+				}
+			}
+			break;
+		}
+	}
+	_edits.clear();
+
+	// a single sort puts shifted records back in their places.
+	if( b_moved ) std::sort( recs.begin(), recs.end(), _edit_Order );
+
+	Clear();
+	int32_t num = 0;
+	for( size_t r = 0; r < recs.size(); r++ )
+	{
+		if( recs[ r ].b_dead ) continue;
+		_eves [ num ]      = recs[ r ].rec;
+		_links[ num ].prev = num - 1;
+		_links[ num ].next = num + 1;
+		num++;
+	}
+	if( num )
+	{
+		_links[ num - 1 ].next = -1;
+		_start = &_eves[ 0 ];
+	}
+	return true;
+}
+
+/////////////////////
+// bulk
+/////////////////////
+
+void pxtnEvelist_Bulk::Clear()
+{
+	_recs.clear();
+}
+
+void pxtnEvelist_Bulk::Reserve( int32_t num )
+{
+	if( num > 0 ) _recs.reserve( num );
+}
+
+bool pxtnEvelist_Bulk::Add_i( int32_t clock, uint8_t unit_no, uint8_t kind, int32_t value )
+{
+	if( kind >= EVENTKIND_NUM ) return false;
+
+	EVERECORD rec = {0};
+	rec.clock   = clock  ;
+	rec.unit_no = unit_no;
+	rec.kind    = kind   ;
+	rec.value   = value  ;
+	_recs.push_back( rec );
+	return true;
+}
+
+bool pxtnEvelist_Bulk::Add_f( int32_t clock, uint8_t unit_no, uint8_t kind, float value_f )
+{
+	int32_t value = 0;
+	memcpy( &value, &value_f, sizeof(value) );
+	return Add_i( clock, unit_no, kind, value );
+}
+
+int32_t pxtnEvelist_Bulk::get_Count() const
+{
+	return (int32_t)_recs.size();
+}
+
+typedef struct
+{
+	EVERECORD rec;
+	int32_t   seq; // the order events were added in, buffer by buffer.
+}
+_BULKREC;
+
+// stable LSD radix sort on the low key_bytes bytes of key(), a byte per pass.
+// the counts for every pass are taken in one read, and passes where every key
+// has the same byte are skipped.
+template< class KEY >
+static void _bulk_Sort( std::vector<_BULKREC>& recs, std::vector<_BULKREC>& tmp, int32_t key_bytes, KEY key )
+{
+	std::vector<size_t> counts( 256 * key_bytes, 0 );
+	for( size_t r = 0; r < recs.size(); r++ )
+	{
+		uint64_t k = key( recs[ r ] );
+		for( int32_t d = 0; d < key_bytes; d++ ) counts[ 256 * d + ( ( k >> ( 8 * d ) ) & 0xff ) ]++;
+	}
+
+	tmp.resize( recs.size() );
+	for( int32_t d = 0; d < key_bytes; d++ )
+	{
+		size_t* offsets = &counts[ 256 * d ];
+
+		bool b_same = false;
+		for( int32_t b = 0; b < 256; b++ ){ if( offsets[ b ] == recs.size() ){ b_same = true; break; } }
+		if( b_same ) continue;
+
+		size_t sum = 0;
+		for( int32_t b = 0; b < 256; b++ ){ size_t n = offsets[ b ]; offsets[ b ] = sum; sum += n; }
+		for( size_t r = 0; r < recs.size(); r++ ) tmp[ offsets[ ( key( recs[ r ] ) >> ( 8 * d ) ) & 0xff ]++ ] = recs[ r ];
+		recs.swap( tmp );
+	}
+}
+
+static uint64_t _bulk_Clock( int32_t clock )
+{
+	return (uint32_t)clock ^ 0x80000000u;
+}
+
+bool pxtnEvelist::Bulk_Install( const pxtnEvelist_Bulk* const* pp_bulks, int32_t bulk_num )
+{
+	if( !_eves ) return false;
+
+	std::vector<_BULKREC> recs, tmp;
+	{
+		size_t num = 0;
+		for( int32_t b = 0; b < bulk_num; b++ ) num += pp_bulks[ b ]->_recs.size();
+		recs.resize( num );
+	}
+	{
+		size_t seq = 0;
+		for( int32_t b = 0; b < bulk_num; b++ )
+		{
+			const std::vector<EVERECORD>& src = pp_bulks[ b ]->_recs;
+			for( size_t r = 0; r < src.size(); r++, seq++ ){ recs[ seq ].rec = src[ r ]; recs[ seq ].seq = (int32_t)seq; }
+		}
+	}
+	const size_t add_num = recs.size();
+
+	// by unit, kind and clock, each group in the order added.
+	_bulk_Sort( recs, tmp, 6, []( const _BULKREC& br ){
+		return ( (uint64_t)br.rec.unit_no << 40 ) | ( (uint64_t)br.rec.kind << 32 ) | _bulk_Clock( br.rec.clock ); } );
+
+	// 置き換え: the last event at a unit, kind and clock wins, in the place of the first.
+	size_t num = 0;
+	for( size_t r = 0; r < recs.size(); r++ )
+	{
+		if( num )
+		{
+			_BULKREC& last = recs[ num - 1 ];
+			if( last.rec.unit_no == recs[ r ].rec.unit_no && last.rec.kind == recs[ r ].rec.kind && last.rec.clock == recs[ r ].rec.clock )
+			{
+				int32_t seq = last.seq;
+				last     = recs[ r ];
+				last.seq = seq;
+				continue;
+			}
+		}
+		recs[ num++ ] = recs[ r ];
+	}
+	recs.resize( num );
+
+	// cut prev tail
+	for( size_t r = 0; r + 1 < recs.size(); r++ )
+	{
+		EVERECORD*       p      = &recs[ r     ].rec;
+		const EVERECORD* p_next = &recs[ r + 1 ].rec;
+		if( !Evelist_Kind_IsTail( p->kind ) || p_next->unit_no != p->unit_no || p_next->kind != p->kind ) continue;
+		if( p_next->clock < p->clock + p->value ) p->value = p_next->clock - p->clock;
+	}
+
+	if( !_grow( (int32_t)recs.size() ) ) return false;
+
+	// back in the order added, which the sort below keeps for ties.
+	tmp.assign( add_num, _BULKREC() );
+	for( size_t r = 0; r < add_num; r++ ) tmp[ r ].seq = -1;
+	for( size_t r = 0; r < recs.size(); r++ ) tmp[ recs[ r ].seq ] = recs[ r ];
+	num = 0;
+	for( size_t r = 0; r < add_num; r++ ){ if( tmp[ r ].seq >= 0 ) recs[ num++ ] = tmp[ r ]; }
+
+	// list order: by clock, then priority, then as added.
+	_bulk_Sort( recs, tmp, 5, []( const _BULKREC& br ){
+		return ( _bulk_Clock( br.rec.clock ) << 8 ) | (uint64_t)_KindPriority( br.rec.kind ); } );
+
+	Clear();
+	for( size_t r = 0; r < recs.size(); r++ )
+	{
+		_eves [ r ]      = recs[ r ].rec;
+		_links[ r ].prev = (int32_t)r - 1;
+		_links[ r ].next = (int32_t)r + 1;
+	}
+	if( !recs.empty() )
+	{
+		_links[ recs.size() - 1 ].next = -1;
+		_start = &_eves[ 0 ];
+	}
+	return true;
+}
+
 /////////////////////
 // linear
 /////////////////////
@@ -611,8 +1237,10 @@ bool pxtnEvelist::Linear_Start()
 }
 
 
-void pxtnEvelist::Linear_Add_i(  int32_t clock, uint8_t unit_no, uint8_t kind, int32_t value )
+bool pxtnEvelist::Linear_Add_i(  int32_t clock, uint8_t unit_no, uint8_t kind, int32_t value )
 {
+	if( !_grow( _linear + 1 ) ) return false;
+
 	EVERECORD* p = &_eves[ _linear ];
 
 	p->clock      = clock  ;
@@ -621,16 +1249,36 @@ void pxtnEvelist::Linear_Add_i(  int32_t clock, uint8_t unit_no, uint8_t kind, i
 	p->value      = value  ;
 
 	_linear++;
+	return true;
 }
 
-void pxtnEvelist::Linear_Add_f( int32_t clock, uint8_t unit_no, uint8_t kind, float value_f )
+bool pxtnEvelist::Linear_Add_f( int32_t clock, uint8_t unit_no, uint8_t kind, float value_f )
 {
 	int32_t value = *( (int32_t*)(&value_f) );
-	Linear_Add_i( clock, unit_no, kind, value );
+	return Linear_Add_i( clock, unit_no, kind, value );
+}
+
+// the records are taken in order, as Linear_Add_i() would; Linear_End() links them.
+bool pxtnEvelist::Linear_Add_Cache( const EVECACHE *p_recs, int32_t num )
+{
+	if( num < 0 || !_grow( _linear + num ) ) return false;
+
+	EVERECORD* p = &_eves[ _linear ];
+	for( int32_t r = 0; r < num; r++, p++ )
+	{
+		p->clock   = p_recs[ r ].clock  ;
+		p->unit_no = p_recs[ r ].unit_no;
+		p->kind    = p_recs[ r ].kind   ;
+		p->value   = p_recs[ r ].value  ;
+	}
+	_linear += num;
+	return true;
 }
 
 void pxtnEvelist::Linear_End( bool b_connect )
 {
+	_index_drop();
+	_b_columns = false;
 	if( _eves[ 0 ].kind != EVENTKIND_NULL ) _start = &_eves[ 0 ];
 
 	if( b_connect )
@@ -638,8 +1286,8 @@ void pxtnEvelist::Linear_End( bool b_connect )
 		for( int32_t r = 1; r < _eve_allocated_num; r++ )
 		{
 			if( _eves[ r ].kind == EVENTKIND_NULL ) break;
-			_eves[ r     ].prev = &_eves[ r - 1 ];
-			_eves[ r - 1 ].next = &_eves[ r     ];
+			_links[ r     ].prev = r - 1;
+			_links[ r - 1 ].next = r    ;
 		}
 	}
 }
@@ -661,12 +1309,15 @@ void pxtnEvelist::x4x_Read_NewKind()
 	_p_x4x_rec = NULL;
 }
 
-void pxtnEvelist::x4x_Read_Add( int32_t clock, uint8_t unit_no, uint8_t kind, int32_t value )
+bool pxtnEvelist::x4x_Read_Add( int32_t clock, uint8_t unit_no, uint8_t kind, int32_t value )
 {
+	_index_drop();
+
 	EVERECORD* p_new  = NULL;
 	EVERECORD* p_prev = NULL;
 	EVERECORD* p_next = NULL;
 
+	if( !_grow( _linear + 1 ) ) return false;
 	p_new = &_eves[ _linear++ ];
 
 	// first.
@@ -685,26 +1336,27 @@ void pxtnEvelist::x4x_Read_Add( int32_t clock, uint8_t unit_no, uint8_t kind, in
 		if( _p_x4x_rec ) p = _p_x4x_rec;
 		else             p = _start    ;
 
-		for( ; p; p = p->next )
+		for( ; p; p = _next( p ) )
 		{
 			if( p->clock == clock ) // 同時
 			{
-				for( ; true; p = p->next )
+				for( ; true; p = _next( p ) )
 				{
-					if( p->clock != clock                        ){ p_prev = p->prev; p_next = p; break; } 
-					if( unit_no == p->unit_no && kind == p->kind ){ p_prev = p->prev; p_next = p->next; p->kind = EVENTKIND_NULL; break; } // 置き換え
-					if( _ComparePriority( kind, p->kind ) < 0    ){ p_prev = p->prev; p_next = p; break; }// プライオリティを検査
-					if( !p->next                                 ){ p_prev = p; break; }// 末端
+					if( p->clock != clock                        ){ p_prev = _prev( p ); p_next = p; break; } 
+					if( unit_no == p->unit_no && kind == p->kind ){ p_prev = _prev( p ); p_next = _next( p ); p->kind = EVENTKIND_NULL; break; } // 置き換え
+					if( _ComparePriority( kind, p->kind ) < 0    ){ p_prev = _prev( p ); p_next = p; break; }// プライオリティを検査
+					if( !_next( p )                              ){ p_prev = p; break; }// 末端
 				}
 				break;
 			}
-			else if( p->clock > clock ){ p_prev = p->prev; p_next = p; break; } // 追い越した
-			else if( !p->next         ){ p_prev = p; break; }// 末端
+			else if( p->clock > clock ){ p_prev = _prev( p ); p_next = p; break; } // 追い越した
+			else if( !_next( p )      ){ p_prev = p; break; }// 末端
 		}
 	}
 	_rec_set( p_new, p_prev, p_next, clock, unit_no, kind, value );
 
 	_p_x4x_rec = p_new;
+	return true;
 }
 
 
@@ -716,45 +1368,40 @@ void pxtnEvelist::x4x_Read_Add( int32_t clock, uint8_t unit_no, uint8_t kind, in
 
 bool pxtnEvelist::io_Write( pxtnDescriptor *p_doc, int32_t rough ) const
 {
-	int32_t eve_num        = get_Count();
+	int32_t eve_num        = 0;
 	int32_t ralatived_size = 0;
 	int32_t absolute       = 0;
 	int32_t clock;
 	int32_t value;
 
-	for( const EVERECORD* p = get_Records(); p; p = p->next )
-	{
-		clock    = p->clock - absolute;
-
-		ralatived_size += pxtnDescriptor_v_chk( p->clock );
-		ralatived_size += 1;
-		ralatived_size += 1;
-		ralatived_size += pxtnDescriptor_v_chk( p->value );
-
-		absolute = p->clock;
-	}
-
-	int32_t size = sizeof(int32_t) + ralatived_size;
+	// size and count are patched in once the events are written.
+	int32_t size = 0;
 	if( !p_doc->w_asfile( &size   , sizeof(int32_t), 1 ) ) return false;
 	if( !p_doc->w_asfile( &eve_num, sizeof(int32_t), 1 ) ) return false;
 
-	absolute = 0;
-
-	for( const EVERECORD* p = get_Records(); p; p = p->next )
+	for( const EVERECORD* p = get_Records(); p; p = _next( p ) )
 	{
 		clock    = p->clock - absolute;
 
 		if( Evelist_Kind_IsTail( p->kind ) ) value = p->value / rough;
 		else                                 value = p->value        ;
 
-		if( !p_doc->v_w_asfile( clock / rough, NULL )    ) return false;
+		if( !p_doc->v_w_asfile( clock / rough, &ralatived_size ) ) return false;
 		if( !p_doc->w_asfile( &p->unit_no, sizeof(uint8_t), 1 ) ) return false;
 		if( !p_doc->w_asfile( &p->kind   , sizeof(uint8_t), 1 ) ) return false;
-		if( !p_doc->v_w_asfile( value        , NULL )    ) return false;
+		if( !p_doc->v_w_asfile( value        , &ralatived_size ) ) return false;
+		ralatived_size += 2;
+		eve_num++;
 
 		absolute = p->clock;
 	}
 
+	size = sizeof(int32_t) + ralatived_size;
+	if( !p_doc->seek( pxtnSEEK_cur, -size - (int32_t)sizeof(int32_t) ) ) return false;
+	if( !p_doc->w_asfile( &size   , sizeof(int32_t), 1 ) ) return false;
+	if( !p_doc->w_asfile( &eve_num, sizeof(int32_t), 1 ) ) return false;
+	if( !p_doc->seek( pxtnSEEK_cur, ralatived_size )     ) return false;
+
 	return true;
 }
 
@@ -766,12 +1413,39 @@ pxtnERR pxtnEvelist::io_Read( pxtnDescriptor *p_doc )
 	if( !p_doc->r( &size   , 4, 1 ) ) return pxtnERR_desc_r;
 	if( !p_doc->r( &eve_num, 4, 1 ) ) return pxtnERR_desc_r;
 
+	// room for the whole chunk at once. every event takes at least 4 bytes,
+	// so a broken count can't ask for more than the chunk could hold.
+	int32_t reserve = eve_num;
+	if( reserve > size / 4 ) reserve = size / 4;
+	if( reserve > 0 && !_grow( _linear + reserve ) ) return _b_growable ? pxtnERR_memory : pxtnERR_too_much_event;
+
 	int32_t clock    = 0;
 	int32_t absolute = 0;
 	uint8_t unit_no  = 0;
 	uint8_t kind     = 0;
 	int32_t value    = 0;
 
+	// in memory, events are decoded in place.
+	int32_t        left  = 0;
+	const uint8_t* p_src = p_doc->get_p_cur( &left );
+	if( p_src )
+	{
+		const uint8_t* p     = p_src;
+		const uint8_t* p_end = p_src + left;
+		for( int32_t e = 0; e < eve_num; e++ )
+		{
+			if( !pxtnDescriptor_v_decode( &p, p_end, &clock ) ) return pxtnERR_desc_r;
+			if( p_end - p < 2                                 ) return pxtnERR_desc_r;
+			unit_no = *p++;
+			kind    = *p++;
+			if( !pxtnDescriptor_v_decode( &p, p_end, &value ) ) return pxtnERR_desc_r;
+			absolute += clock;
+			if( !Linear_Add_i( absolute, unit_no, kind, value ) ) return _b_growable ? pxtnERR_memory : pxtnERR_too_much_event;
+		}
+		if( !p_doc->seek( pxtnSEEK_cur, (int32_t)( p - p_src ) ) ) return pxtnERR_desc_r;
+		return pxtnOK;
+	}
+
 	for( int32_t e = 0; e < eve_num; e++ )
 	{
 		if( !p_doc->v_r( &clock         ) ) return pxtnERR_desc_r;
@@ -780,37 +1454,62 @@ pxtnERR pxtnEvelist::io_Read( pxtnDescriptor *p_doc )
 		if( !p_doc->v_r( &value         ) ) return pxtnERR_desc_r;
 		absolute += clock;
 		clock     = absolute;
-		Linear_Add_i( clock, unit_no, kind, value );
+		if( !Linear_Add_i( clock, unit_no, kind, value ) ) return _b_growable ? pxtnERR_memory : pxtnERR_too_much_event;
 	}
 
 	return pxtnOK;
 }
 
-int32_t pxtnEvelist::io_Read_EventNum( pxtnDescriptor *p_doc ) const
+// walks an event chunk without keeping it: the number of events, and the
+// clock the last of them ends at (see get_Max_Clock()).
+pxtnERR pxtnEvelist::io_Read_EventNum( pxtnDescriptor *p_doc, int32_t* p_num, int32_t* p_max_clock ) const
 {
-	int32_t size    = 0;
-	int32_t eve_num = 0;
+	if( !p_doc || !p_num || !p_max_clock ) return pxtnERR_param;
 
-	if( !p_doc->r( &size   , 4, 1 ) ) return 0;
-	if( !p_doc->r( &eve_num, 4, 1 ) ) return 0;
+	int32_t size      = 0;
+	int32_t eve_num   = 0;
 
-	int32_t count   = 0;
-	int32_t clock   = 0;
-	uint8_t unit_no = 0;
-	uint8_t kind    = 0;
-	int32_t value   = 0;
+	if( !p_doc->r( &size   , 4, 1 ) ) return pxtnERR_desc_r;
+	if( !p_doc->r( &eve_num, 4, 1 ) ) return pxtnERR_desc_r;
+
+	int32_t clock     = 0;
+	int32_t absolute  = 0;
+	int32_t max_clock = 0;
+	uint8_t unit_no   = 0;
+	uint8_t kind      = 0;
+	int32_t value     = 0;
+
+	int32_t        left  = 0;
+	const uint8_t* p_src = p_doc->get_p_cur( &left );
+	const uint8_t* p     = p_src;
 
 	for( int32_t e = 0; e < eve_num; e++ )
 	{
-		if( !p_doc->v_r( &clock         ) ) return 0;
-		if( !p_doc->r  ( &unit_no, 1, 1 ) ) return 0;
-		if( !p_doc->r  ( &kind   , 1, 1 ) ) return 0;
-		if( !p_doc->v_r( &value         ) ) return 0;
-		count++;
+		if( p_src )
+		{
+			if( !pxtnDescriptor_v_decode( &p, p_src + left, &clock ) ) return pxtnERR_desc_r;
+			if( p_src + left - p < 2                                ) return pxtnERR_desc_r;
+			kind = p[ 1 ];
+			p   += 2;
+			if( !pxtnDescriptor_v_decode( &p, p_src + left, &value ) ) return pxtnERR_desc_r;
+		}
+		else
+		{
+			if( !p_doc->v_r( &clock         ) ) return pxtnERR_desc_r;
+			if( !p_doc->r  ( &unit_no, 1, 1 ) ) return pxtnERR_desc_r;
+			if( !p_doc->r  ( &kind   , 1, 1 ) ) return pxtnERR_desc_r;
+			if( !p_doc->v_r( &value         ) ) return pxtnERR_desc_r;
+		}
+		absolute += clock;
+		if( Evelist_Kind_IsTail( kind ) ) clock = absolute + value;
+		else                              clock = absolute        ;
+		if( clock > max_clock ) max_clock = clock;
 	}
-	if( count != eve_num ) return 0;
+	if( p_src && !p_doc->seek( pxtnSEEK_cur, (int32_t)( p - p_src ) ) ) return pxtnERR_desc_r;
 
-	return eve_num;
+	*p_num       = eve_num < 0 ? 0 : eve_num;
+	*p_max_clock = max_clock;
+	return pxtnOK;
 }
 
 
@@ -842,6 +1541,11 @@ pxtnERR pxtnEvelist::io_Unit_Read_x4x_EVENT( pxtnDescriptor *p_doc, bool bTailAb
 	if( evnt.event_kind >= EVENTKIND_NUM ) return pxtnERR_fmt_unknown;
 	if( bCheckRRR && evnt.rrr            ) return pxtnERR_fmt_unknown;
 
+	// every event takes at least 2 bytes.
+	int32_t reserve = (int32_t)evnt.event_num;
+	if( reserve < 0 || reserve > size / 2 ) reserve = size / 2;
+	if( reserve > 0 && !_grow( _linear + reserve ) ) return _b_growable ? pxtnERR_memory : pxtnERR_too_much_event;
+
 	absolute = 0;
 	for( e = 0; e < (int32_t)evnt.event_num; e++ )
 	{
@@ -849,7 +1553,7 @@ pxtnERR pxtnEvelist::io_Unit_Read_x4x_EVENT( pxtnDescriptor *p_doc, bool bTailAb
 		if( !p_doc->v_r( &value ) ) break;
 		absolute += clock;
 		clock     = absolute;
-		x4x_Read_Add( clock, (uint8_t)evnt.unit_index, (uint8_t)evnt.event_kind, value );
+		if( !x4x_Read_Add( clock, (uint8_t)evnt.unit_index, (uint8_t)evnt.event_kind, value ) ) return _b_growable ? pxtnERR_memory : pxtnERR_too_much_event;
 		if( bTailAbsolute && Evelist_Kind_IsTail( evnt.event_kind ) ) absolute += value;
 	}
 	if( e != evnt.event_num ) return pxtnERR_desc_broken;
@@ -1,6 +1,11 @@
 ﻿#ifndef pxtnEvelist_H
 #define pxtnEvelist_H
 
+#include <functional>
+#include <map>
+#include <queue>
+#include <vector>
+
 #include "./pxtn.h"
 
 #include "./pxtnDescriptor.h"
@@ -49,10 +54,45 @@ typedef struct EVERECORD {
   uint8_t reserve2;
   int32_t value;
   int32_t clock;
-  EVERECORD *prev;
-  EVERECORD *next;
 } EVERECORD;
 
+// The neighbours of the record in the same slot, as slot numbers (-1 for
+// none). Kept apart from the records so a walk over them stays compact.
+typedef struct {
+  int32_t prev;
+  int32_t next;
+} EVELINK;
+
+// an event without its links, as a .ptcache keeps it (see
+// pxtnService::read_cache).
+typedef struct EVECACHE {
+  int32_t clock;
+  int32_t value;
+  uint8_t unit_no;
+  uint8_t kind;
+  uint8_t reserve1;
+  uint8_t reserve2;
+} EVECACHE;
+
+//--------------------------------
+
+// Events for pxtnEvelist::Bulk_Install(), added in any order. A buffer isn't
+// locked, so each producing thread fills its own.
+class pxtnEvelist_Bulk {
+  std::vector<EVERECORD> _recs;
+  friend class pxtnEvelist;
+
+public:
+  void Clear();
+  void Reserve(int32_t num);
+
+  // Fails for an unknown kind.
+  bool Add_i(int32_t clock, uint8_t unit_no, uint8_t kind, int32_t value);
+  bool Add_f(int32_t clock, uint8_t unit_no, uint8_t kind, float value_f);
+
+  int32_t get_Count() const;
+};
+
 //--------------------------------
 
 class pxtnEvelist {
@@ -65,11 +105,68 @@ private:
 
   int32_t _eve_allocated_num;
   EVERECORD *_eves;
+  EVELINK *_links;
   EVERECORD *_start;
   int32_t _linear;
+  bool _b_growable;
 
   EVERECORD *_p_x4x_rec;
 
+  // Edits queued by the Edit_ functions, applied by Edit_Commit().
+  struct _EDITOP {
+    int32_t type;
+    int32_t clock1;
+    int32_t clock2;
+    int32_t value;
+    uint8_t unit_no;
+    uint8_t kind;
+  };
+  std::vector<_EDITOP> _edits;
+  void _edit_push(int32_t type, int32_t clock1, int32_t clock2, int32_t value,
+                  uint8_t unit_no, uint8_t kind);
+
+  // Lets Record_Add_i() find its place without walking the list: the free
+  // slots (lowest first, as a scan would pick them), the first record at
+  // each clock and the tail events by (unit, kind, clock). Built on the first
+  // Record_Add_i() and dropped by anything that rewrites the list wholesale.
+  bool _b_indexed;
+  std::priority_queue<int32_t, std::vector<int32_t>, std::greater<int32_t>>
+      _free;
+  std::map<int32_t, int32_t> _clock_index;
+  std::map<uint64_t, int32_t> _tail_index;
+
+  void _index_build();
+  void _index_drop();
+
+  // The records split by unit and kind, for queries about one unit: each
+  // column holds clocks and values in list order, and each unit its record
+  // slots. Built by the first query after a change, so const queries on one
+  // list aren't safe to run from several threads at once.
+  struct _COLUMN {
+    std::vector<int32_t> clocks;
+    std::vector<int32_t> values;
+  };
+  mutable bool _b_columns;
+  mutable std::vector<_COLUMN> _columns; // [ unit_no * EVENTKIND_NUM + kind ]
+  mutable std::vector<std::vector<int32_t>> _unit_recs;
+
+  const _COLUMN *_column(uint8_t unit_no, uint8_t kind) const;
+  const std::vector<int32_t> *_unit_records(uint8_t unit_no) const;
+  void _columns_build() const;
+
+  int32_t _slot(const EVERECORD *p) const {
+    return p ? (int32_t)(p - _eves) : -1;
+  }
+  EVERECORD *_next(const EVERECORD *p) const {
+    int32_t next = _links[p - _eves].next;
+    return next < 0 ? NULL : &_eves[next];
+  }
+  EVERECORD *_prev(const EVERECORD *p) const {
+    int32_t prev = _links[p - _eves].prev;
+    return prev < 0 ? NULL : &_eves[prev];
+  }
+
+  bool _grow(int32_t num);
   void _rec_set(EVERECORD *p_rec, EVERECORD *prev, EVERECORD *next,
                 int32_t clock, uint8_t unit_no, uint8_t kind, int32_t value);
   void _rec_cut(EVERECORD *p_rec);
@@ -81,7 +178,9 @@ public:
   pxtnEvelist();
   ~pxtnEvelist();
 
-  bool Allocate(int32_t max_event_num);
+  // A growable list gets more room as events are added; otherwise adding
+  // fails once max_event_num are in use.
+  bool Allocate(int32_t max_event_num, bool b_growable = false);
 
   int32_t get_Num_Max() const;
   int32_t get_Max_Clock() const;
@@ -92,7 +191,15 @@ public:
   int32_t get_Count(int32_t clock1, int32_t clock2, uint8_t unit_no) const;
   int32_t get_Value(int32_t clock, uint8_t unit_no, uint8_t kind) const;
 
+  // The first record in clock order; get_Next() steps through the rest.
   const EVERECORD *get_Records() const;
+  const EVERECORD *get_Next(const EVERECORD *p) const { return _next(p); }
+
+  // One unit's events of one kind in clock order, as parallel arrays of
+  // clocks and values. Returns their count; the arrays are valid until the
+  // list is next changed.
+  int32_t get_Column(uint8_t unit_no, uint8_t kind, const int32_t **pp_clocks,
+                     const int32_t **pp_values) const;
 
   bool Record_Add_i(int32_t clock, uint8_t unit_no, uint8_t kind,
                     int32_t value);
@@ -100,10 +207,11 @@ public:
                     float value_f);
 
   bool Linear_Start();
-  void Linear_Add_i(int32_t clock, uint8_t unit_no, uint8_t kind,
+  bool Linear_Add_i(int32_t clock, uint8_t unit_no, uint8_t kind,
                     int32_t value);
-  void Linear_Add_f(int32_t clock, uint8_t unit_no, uint8_t kind,
+  bool Linear_Add_f(int32_t clock, uint8_t unit_no, uint8_t kind,
                     float value_f);
+  bool Linear_Add_Cache(const EVECACHE *p_recs, int32_t num);
   void Linear_End(bool b_connect);
 
   int32_t Record_Clock_Shift(int32_t clock, int32_t shift,
@@ -125,14 +233,40 @@ public:
 
   int32_t BeatClockOperation(int32_t rate);
 
+  // Edit transactions. The Edit_ functions only queue the matching Record_
+  // edit; Edit_Commit() applies the queue in order to a flat copy of the
+  // records and relinks the list once, with the same result as making the
+  // Record_ calls one by one. Edit_Cancel() drops the queue.
+  void Edit_Clock_Shift(int32_t clock, int32_t shift, uint8_t unit_no);
+  void Edit_Value_Set(int32_t clock1, int32_t clock2, uint8_t unit_no,
+                      uint8_t kind, int32_t value);
+  void Edit_Value_Change(int32_t clock1, int32_t clock2, uint8_t unit_no,
+                         uint8_t kind, int32_t value);
+  void Edit_Delete(int32_t clock1, int32_t clock2, uint8_t unit_no,
+                   uint8_t kind);
+  void Edit_Delete(int32_t clock1, int32_t clock2, uint8_t unit_no);
+  void Edit_UnitNo_Replace(uint8_t old_u, uint8_t new_u);
+  bool Edit_Commit();
+  void Edit_Cancel();
+
+  // Replaces the list with the events of the buffers. The result is the same
+  // as adding them with Record_Add_i() in clock order, events at one clock
+  // taken buffer by buffer in the order they were added, so a later event
+  // replaces one of the same unit, kind and clock and tails are cut short by
+  // the next one. The buffers are sorted together once instead of each event
+  // searching the list. Fails, leaving the list as it was, if a list that
+  // can't grow is too small.
+  bool Bulk_Install(const pxtnEvelist_Bulk *const *pp_bulks, int32_t bulk_num);
+
   bool io_Write(pxtnDescriptor *p_doc, int32_t rough) const;
   pxtnERR io_Read(pxtnDescriptor *p_doc);
 
-  int32_t io_Read_EventNum(pxtnDescriptor *p_doc) const;
+  pxtnERR io_Read_EventNum(pxtnDescriptor *p_doc, int32_t *p_num,
+                           int32_t *p_max_clock) const;
 
   bool x4x_Read_Start();
   void x4x_Read_NewKind();
-  void x4x_Read_Add(int32_t clock, uint8_t unit_no, uint8_t kind,
+  bool x4x_Read_Add(int32_t clock, uint8_t unit_no, uint8_t kind,
                     int32_t value);
 
   pxtnERR io_Unit_Read_x4x_EVENT(pxtnDescriptor *p_doc, bool bTailAbsolute,
@@ -102,6 +102,10 @@ pxtnService::pxtnService() {
 
   _ptn_bldr = NULL;
 
+  _lazy_doc = NULL;
+
+  _tone_cache_dir = NULL;
+
   _sampled_proc = NULL;
   _sampled_user = NULL;
 
@@ -146,7 +150,10 @@ bool pxtnService::_release() {
   return true;
 }
 
-pxtnService::~pxtnService() { _release(); }
+pxtnService::~pxtnService() {
+  _release();
+  free(_tone_cache_dir);
+}
 
 pxtnERR pxtnService::init() { return _init(0, false); }
 pxtnERR pxtnService::init_collage(int32_t fix_evels_num) {
@@ -271,7 +278,7 @@ pxtnERR pxtnService::tones_ready() {
     _ovdrvs[i]->Tone_Ready();
   }
   for (int32_t i = 0; i < _woice_num; i++) {
-    res = _woices[i]->Tone_Ready(_ptn_bldr, _dst_sps);
+    res = _woice_ReadyTone(i);
     if (res != pxtnOK)
       return res;
   }
@@ -456,7 +463,7 @@ pxtnERR pxtnService::Woice_ReadyTone(int32_t idx) {
     return pxtnERR_INIT;
   if (idx < 0 || idx >= _woice_num)
     return pxtnERR_param;
-  return _woices[idx]->Tone_Ready(_ptn_bldr, _dst_sps);
+  return _woice_ReadyTone(idx);
 }
 
 bool pxtnService::Woice_Remove(int32_t idx) {
@@ -691,6 +698,8 @@ bool pxtnService::clear() {
   if (!_b_edit)
     _moo_b_valid_data = false;
 
+  _lazy_doc = NULL;
+
   if (!text->set_name_buf("", 0))
     return false;
   if (!text->set_comment_buf("", 0))
@@ -701,7 +710,7 @@ bool pxtnService::clear() {
   for (int32_t i = 0; i < _delay_num; i++)
     SAFE_DELETE(_delays[i]);
   _delay_num = 0;
-  for (int32_t i = 0; i < _delay_num; i++)
+  for (int32_t i = 0; i < _ovdrv_num; i++)
     SAFE_DELETE(_ovdrvs[i]);
   _ovdrv_num = 0;
   for (int32_t i = 0; i < _woice_num; i++)
@@ -782,36 +791,42 @@ pxtnERR pxtnService::_io_Read_Woice(pxtnDescriptor *p_doc, pxtnWOICETYPE type) {
 
   pxtnWoice *woice = new pxtnWoice();
 
-  switch (type) {
-  case pxtnWOICE_PCM:
-    res = woice->io_matePCM_r(p_doc);
-    if (res != pxtnOK)
-      goto term;
-    break;
-  case pxtnWOICE_PTV:
-    res = woice->io_matePTV_r(p_doc);
+  if (_lazy_doc) {
+    res = woice->io_mate_r_lazy(p_doc, type);
     if (res != pxtnOK)
       goto term;
-    break;
-  case pxtnWOICE_PTN:
-    res = woice->io_matePTN_r(p_doc);
-    if (res != pxtnOK)
-      goto term;
-    break;
-  case pxtnWOICE_OGGV:
+  } else {
+    switch (type) {
+    case pxtnWOICE_PCM:
+      res = woice->io_matePCM_r(p_doc);
+      if (res != pxtnOK)
+        goto term;
+      break;
+    case pxtnWOICE_PTV:
+      res = woice->io_matePTV_r(p_doc);
+      if (res != pxtnOK)
+        goto term;
+      break;
+    case pxtnWOICE_PTN:
+      res = woice->io_matePTN_r(p_doc);
+      if (res != pxtnOK)
+        goto term;
+      break;
+    case pxtnWOICE_OGGV:
 #ifdef pxINCLUDE_OGGVORBIS
-    res = woice->io_mateOGGV_r(p_doc);
-    if (res != pxtnOK)
-      goto term;
+      res = woice->io_mateOGGV_r(p_doc);
+      if (res != pxtnOK)
+        goto term;
 #else
-    res = pxtnERR_ogg_no_supported;
-    goto term;
+      res = pxtnERR_ogg_no_supported;
+      goto term;
 #endif
-    break;
+      break;
 
-  default:
-    res = pxtnERR_fmt_unknown;
-    goto term;
+    default:
+      res = pxtnERR_fmt_unknown;
+      goto term;
+    }
   }
   _woices[_woice_num] = woice;
   _woice_num++;
@@ -822,6 +837,14 @@ term:
   return res;
 }
 
+pxtnERR pxtnService::_io_Load_Woice(int32_t idx) {
+  if (!_woices[idx]->is_lazy())
+    return pxtnOK;
+  if (!_lazy_doc)
+    return pxtnERR_INIT;
+  return _woices[idx]->io_mate_load(_lazy_doc);
+}
+
 pxtnERR pxtnService::_io_Read_OldUnit(pxtnDescriptor *p_doc, int32_t ver) {
   if (!_b_init)
     return pxtnERR_INIT;
@@ -852,10 +875,17 @@ pxtnERR pxtnService::_io_Read_OldUnit(pxtnDescriptor *p_doc, int32_t ver) {
   if (group >= _group_num)
     group = _group_num - 1;
 
-  evels->x4x_Read_Add(0, (uint8_t)_unit_num, EVENTKIND_GROUPNO, (int32_t)group);
+  if (!evels->x4x_Read_Add(0, (uint8_t)_unit_num, EVENTKIND_GROUPNO,
+                           (int32_t)group)) {
+    res = _b_fix_evels_num ? pxtnERR_too_much_event : pxtnERR_memory;
+    goto term;
+  }
   evels->x4x_Read_NewKind();
-  evels->x4x_Read_Add(0, (uint8_t)_unit_num, EVENTKIND_VOICENO,
-                      (int32_t)_unit_num);
+  if (!evels->x4x_Read_Add(0, (uint8_t)_unit_num, EVENTKIND_VOICENO,
+                           (int32_t)_unit_num)) {
+    res = _b_fix_evels_num ? pxtnERR_too_much_event : pxtnERR_memory;
+    goto term;
+  }
   evels->x4x_Read_NewKind();
 
   res = pxtnOK;
@@ -1145,6 +1175,10 @@ pxtnERR pxtnService::write(pxtnDescriptor *p_doc, bool b_tune,
   for (int32_t w = 0; w < _woice_num; w++) {
     pxtnWoice *p_w = _woices[w];
 
+    res = _io_Load_Woice(w);
+    if (res != pxtnOK)
+      goto End;
+
     switch (p_w->get_type()) {
     case pxtnWOICE_PCM:
       if (!p_doc->w_asfile(_code_matePCM, 1, _CODESIZE)) {
@@ -1244,6 +1278,11 @@ pxtnERR pxtnService::write(pxtnDescriptor *p_doc, bool b_tune,
     }
   }
 
+  if (!p_doc->w_flush()) {
+    res = pxtnERR_desc_w;
+    goto End;
+  }
+
   res = pxtnOK;
 End:
 
@@ -1254,7 +1293,8 @@ End:
 // Read Project //////////////
 ////////////////////////////////////////
 
-pxtnERR pxtnService::_ReadTuneItems(pxtnDescriptor *p_doc) {
+pxtnERR pxtnService::_ReadTuneItems(pxtnDescriptor *p_doc,
+                                    _enum_FMTVER fmt_ver) {
   if (!_b_init)
     return pxtnERR_INIT;
 
@@ -1270,6 +1310,15 @@ pxtnERR pxtnService::_ReadTuneItems(pxtnDescriptor *p_doc) {
     }
 
     _enum_Tag tag = _CheckTagCode(code);
+
+    /// x1x items only belong in x1x projects
+    if (fmt_ver != _enum_FMTVER_x1x &&
+        (tag == _TAG_x1x_PROJ || tag == _TAG_x1x_UNIT || tag == _TAG_x1x_PCM ||
+         tag == _TAG_x1x_EVEN || tag == _TAG_x1x_END)) {
+      res = pxtnERR_x1x_ignore;
+      goto term;
+    }
+
     switch (tag) {
     case _TAG_antiOPER:
       res = pxtnERR_anti_opreation;
@@ -1317,14 +1366,16 @@ pxtnERR pxtnService::_ReadTuneItems(pxtnDescriptor *p_doc) {
 
     case _TAG_mateOGGV:
 
-#ifdef pxINCLUDE_OGGVORBIS
+#ifndef pxINCLUDE_OGGVORBIS
+      // a lazy read can still list it; loading it fails.
+      if (!_lazy_doc) {
+        res = pxtnERR_ogg_no_supported;
+        goto term;
+      }
+#endif
       res = _io_Read_Woice(p_doc, pxtnWOICE_OGGV);
       if (res != pxtnOK)
         goto term;
-#else
-      res = pxtnERR_ogg_no_supported;
-      goto term;
-#endif
       break;
 
     case _TAG_effeDELA:
@@ -1417,7 +1468,7 @@ term:
   return res;
 }
 
-#define _MAX_FMTVER_x1x_EVENTNUM 10000
+#define _EVENT_NUM_FIRST 1024
 
 pxtnERR pxtnService::_ReadVersion(pxtnDescriptor *p_doc,
                                   _enum_FMTVER *p_fmt_ver,
@@ -1520,142 +1571,29 @@ bool pxtnService::_x3x_SetVoiceNames() {
   return true;
 }
 
-pxtnERR pxtnService::_pre_count_event(pxtnDescriptor *p_doc, int32_t *p_count) {
-  if (!_b_init)
-    return pxtnERR_INIT;
-  if (!p_count)
-    return pxtnERR_param;
-
-  pxtnERR res = pxtnERR_VOID;
-  bool b_end = false;
-
-  int32_t count = 0;
-  int32_t c = 0;
-  int32_t size = 0;
-  char code[_CODESIZE + 1] = {'\0'};
-
-  uint16_t exe_ver = 0;
-  _enum_FMTVER fmt_ver = _enum_FMTVER_unknown;
-
-  res = _ReadVersion(p_doc, &fmt_ver, &exe_ver);
-  if (res != pxtnOK)
-    goto term;
-
-  if (fmt_ver == _enum_FMTVER_x1x) {
-    count = _MAX_FMTVER_x1x_EVENTNUM;
-    res = pxtnOK;
-    goto term;
-  }
-
-  while (!b_end) {
-    if (!p_doc->r(code, 1, _CODESIZE)) {
-      res = pxtnERR_desc_r;
-      goto term;
-    }
-
-    switch (_CheckTagCode(code)) {
-    /// Though these functions call functions on evels and master, these are
-    /// just checks to see if the event is valid. The appropriate size is
-    /// returned if they are.
-    case _TAG_Event_V5:
-      count += evels->io_Read_EventNum(p_doc);
-      break;
-    case _TAG_MasterV5:
-      count += master->io_r_v5_EventNum(p_doc);
-      break;
-    case _TAG_x4x_evenMAST:
-      count += master->io_r_x4x_EventNum(p_doc);
-      break;
-    case _TAG_x4x_evenUNIT:
-      res = evels->io_Read_x4x_EventNum(p_doc, &c);
-      if (res != pxtnOK)
-        goto term;
-      count += c;
-      break;
-    case _TAG_pxtoneND:
-      b_end = true;
-      break;
-
-    // skip
-    case _TAG_antiOPER:
-    case _TAG_num_UNIT:
-    case _TAG_x3x_pxtnUNIT:
-    case _TAG_matePCM:
-    case _TAG_matePTV:
-    case _TAG_matePTN:
-    case _TAG_mateOGGV:
-    case _TAG_effeDELA:
-    case _TAG_effeOVER:
-    case _TAG_textNAME:
-    case _TAG_textCOMM:
-    case _TAG_assiUNIT:
-    case _TAG_assiWOIC:
-
-      if (!p_doc->r(&size, sizeof(int32_t), 1)) {
-        res = pxtnERR_desc_r;
-        goto term;
-      }
-      if (!p_doc->seek(pxtnSEEK_cur, size)) {
-        res = pxtnERR_desc_r;
-        goto term;
-      }
-      break;
-
-    // ignore
-    case _TAG_x1x_PROJ:
-    case _TAG_x1x_UNIT:
-    case _TAG_x1x_PCM:
-    case _TAG_x1x_EVEN:
-    case _TAG_x1x_END:
-      res = pxtnERR_x1x_ignore;
-      goto term;
-    default:
-      res = pxtnERR_FATAL;
-      goto term;
-    }
-  }
-
-  if (fmt_ver <= _enum_FMTVER_x3x)
-    count += pxtnMAX_TUNEUNITSTRUCT *
-             4; // voice_no, group_no, key tuning, key event x3x
-
-  res = pxtnOK;
-term:
-
-  if (res != pxtnOK)
-    *p_count = 0;
-  else
-    *p_count = count;
+pxtnERR pxtnService::read(pxtnDescriptor *p_doc) {
+  return _read(p_doc, false);
+}
 
-  return res;
+pxtnERR pxtnService::read_lazy(pxtnDescriptor *p_doc) {
+  return _read(p_doc, true);
 }
 
-pxtnERR pxtnService::read(pxtnDescriptor *p_doc) {
+pxtnERR pxtnService::_read(pxtnDescriptor *p_doc, bool b_lazy) {
   if (!_b_init)
     return pxtnERR_INIT;
 
   pxtnERR res = pxtnERR_VOID;
   uint16_t exe_ver = 0;
   _enum_FMTVER fmt_ver = _enum_FMTVER_unknown;
-  int32_t event_num = 0;
 
   clear();
 
-  /// counts the # of events
-  res = _pre_count_event(p_doc, &event_num);
-  if (res != pxtnOK)
-    goto term;
-  p_doc->seek(pxtnSEEK_set, 0);
-  /// but also put it back to the start
-
-  /// handle fixed vs. variable # events
-  if (_b_fix_evels_num) {
-    if (event_num > evels->get_Num_Max()) {
-      res = pxtnERR_too_much_event;
-      goto term;
-    }
-  } else {
-    if (!evels->Allocate(event_num)) {
+  /// The file is read in a single pass. Without a fixed # of events, the
+  /// event list grows as event chunks come in; each chunk says how many
+  /// events it holds.
+  if (!_b_fix_evels_num) {
+    if (!evels->Allocate(_EVENT_NUM_FIRST, true)) {
       res = pxtnERR_memory;
       goto term;
     }
@@ -1666,13 +1604,17 @@ pxtnERR pxtnService::read(pxtnDescriptor *p_doc) {
   if (res != pxtnOK)
     goto term;
 
+  /// x3x key events are tuned by the woices' payloads, so those are read now.
+  if (b_lazy && fmt_ver > _enum_FMTVER_x3x)
+    _lazy_doc = p_doc;
+
   if (fmt_ver >= _enum_FMTVER_v5)
     evels->Linear_Start();
   else
     evels->x4x_Read_Start();
 
   /// the thing that actually reads everything?
-  res = _ReadTuneItems(p_doc);
+  res = _ReadTuneItems(p_doc, fmt_ver);
   if (res != pxtnOK)
     goto term;
 
@@ -1716,6 +1658,214 @@ term:
   return res;
 }
 
+/// Reads only what it takes to list a project. Voices and effects are
+/// skipped by their sizes and events are walked without being kept.
+/// Projects older than v5 are read in full, through this service.
+pxtnERR pxtnService::scan(pxtnDescriptor *p_doc, pxtnSCANINFO *p_info) {
+  if (!_b_init)
+    return pxtnERR_INIT;
+  if (!p_doc || !p_info)
+    return pxtnERR_param;
+
+  pxtnERR res = pxtnERR_VOID;
+  bool b_end = false;
+  char code[_CODESIZE + 1] = {'\0'};
+  uint16_t exe_ver = 0;
+  _enum_FMTVER fmt_ver = _enum_FMTVER_unknown;
+  int32_t size = 0;
+  int32_t max_clock = 0;
+
+  p_info->text.set_name_buf("", 0);
+  p_info->text.set_comment_buf("", 0);
+  p_info->master.Reset();
+  p_info->event_num = 0;
+  p_info->unit_num = 0;
+  p_info->woice_num = 0;
+  memset(p_info->unit_names, 0, sizeof(p_info->unit_names));
+  memset(p_info->woice_names, 0, sizeof(p_info->woice_names));
+
+  res = _ReadVersion(p_doc, &fmt_ver, &exe_ver);
+  if (res != pxtnOK)
+    return res;
+  if (fmt_ver < _enum_FMTVER_v5)
+    return _scan_by_read(p_doc, p_info);
+
+  while (!b_end) {
+    if (!p_doc->r(code, 1, _CODESIZE))
+      return pxtnERR_desc_r;
+
+    _enum_Tag tag = _CheckTagCode(code);
+    switch (tag) {
+    case _TAG_antiOPER:
+      return pxtnERR_anti_opreation;
+
+    case _TAG_num_UNIT:
+      res = _io_UNIT_num_r(p_doc, &p_info->unit_num);
+      if (res != pxtnOK)
+        return res;
+      break;
+    case _TAG_MasterV5:
+      res = p_info->master.io_r_v5(p_doc);
+      if (res != pxtnOK)
+        return res;
+      break;
+    case _TAG_Event_V5: {
+      int32_t num = 0;
+      int32_t clock = 0;
+      res = evels->io_Read_EventNum(p_doc, &num, &clock);
+      if (res != pxtnOK)
+        return res;
+      p_info->event_num += num;
+      if (clock > max_clock)
+        max_clock = clock;
+      break;
+    }
+
+    /// the voice type is all that's kept
+    case _TAG_matePCM:
+    case _TAG_matePTV:
+    case _TAG_matePTN:
+    case _TAG_mateOGGV:
+      if (p_info->woice_num >= _woice_max)
+        return pxtnERR_woice_full;
+      switch (tag) {
+      case _TAG_matePCM:
+        p_info->woice_types[p_info->woice_num] = pxtnWOICE_PCM;
+        break;
+      case _TAG_matePTV:
+        p_info->woice_types[p_info->woice_num] = pxtnWOICE_PTV;
+        break;
+      case _TAG_matePTN:
+        p_info->woice_types[p_info->woice_num] = pxtnWOICE_PTN;
+        break;
+      default:
+        p_info->woice_types[p_info->woice_num] = pxtnWOICE_OGGV;
+        break;
+      }
+      p_info->woice_num++;
+      // fall through
+    case _TAG_effeDELA:
+    case _TAG_effeOVER:
+      if (!p_doc->r(&size, sizeof(int32_t), 1))
+        return pxtnERR_desc_r;
+      if (size < 0 || !p_doc->seek(pxtnSEEK_cur, size))
+        return pxtnERR_desc_r;
+      break;
+
+    case _TAG_textNAME:
+      if (!p_info->text.Name_r(p_doc))
+        return pxtnERR_desc_r;
+      break;
+    case _TAG_textCOMM:
+      if (!p_info->text.Comment_r(p_doc))
+        return pxtnERR_desc_r;
+      break;
+    case _TAG_assiWOIC: {
+      _ASSIST_WOICE assi = {0};
+      if (!p_doc->r(&size, 4, 1))
+        return pxtnERR_desc_r;
+      if (size != sizeof(assi))
+        return pxtnERR_fmt_unknown;
+      if (!p_doc->r(&assi, size, 1))
+        return pxtnERR_desc_r;
+      if (assi.rrr || assi.woice_index >= p_info->woice_num)
+        return pxtnERR_fmt_unknown;
+      memcpy(p_info->woice_names[assi.woice_index], assi.name,
+             pxtnMAX_TUNEWOICENAME);
+      break;
+    }
+    case _TAG_assiUNIT: {
+      _ASSIST_UNIT assi = {0};
+      if (!p_doc->r(&size, 4, 1))
+        return pxtnERR_desc_r;
+      if (size != sizeof(assi))
+        return pxtnERR_fmt_unknown;
+      if (!p_doc->r(&assi, size, 1))
+        return pxtnERR_desc_r;
+      if (assi.rrr || assi.unit_index >= p_info->unit_num)
+        return pxtnERR_fmt_unknown;
+      memcpy(p_info->unit_names[assi.unit_index], assi.name,
+             pxtnMAX_TUNEUNITNAME);
+      break;
+    }
+    case _TAG_pxtoneND:
+      b_end = true;
+      break;
+
+    /// old items in a new project; read() knows what to do with them
+    case _TAG_x4x_evenMAST:
+    case _TAG_x4x_evenUNIT:
+    case _TAG_x3x_pxtnUNIT:
+      return _scan_by_read(p_doc, p_info);
+
+    case _TAG_x1x_PROJ:
+    case _TAG_x1x_UNIT:
+    case _TAG_x1x_PCM:
+    case _TAG_x1x_EVEN:
+    case _TAG_x1x_END:
+      return pxtnERR_x1x_ignore;
+    default:
+      return pxtnERR_fmt_unknown;
+    }
+  }
+
+  if (max_clock < p_info->master.get_last_clock())
+    max_clock = p_info->master.get_last_clock();
+  p_info->master.AdjustMeasNum(max_clock);
+
+  return pxtnOK;
+}
+
+pxtnERR pxtnService::_scan_by_read(pxtnDescriptor *p_doc,
+                                   pxtnSCANINFO *p_info) {
+  if (!p_doc->seek(pxtnSEEK_set, 0))
+    return pxtnERR_desc_r;
+
+  pxtnERR res = read(p_doc);
+  if (res != pxtnOK)
+    return res;
+
+  const char *p_name = NULL;
+  int32_t size = 0;
+
+  if (text->is_name_buf()) {
+    p_name = text->get_name_buf(&size);
+    p_info->text.set_name_buf(p_name, size);
+  }
+  if (text->is_comment_buf()) {
+    p_name = text->get_comment_buf(&size);
+    p_info->text.set_comment_buf(p_name, size);
+  }
+
+  {
+    int32_t beat_num, beat_clock, meas_num;
+    float beat_tempo;
+    master->Get(&beat_num, &beat_tempo, &beat_clock, &meas_num);
+    p_info->master.Set(beat_num, beat_tempo, beat_clock);
+    p_info->master.set_repeat_meas(master->get_repeat_meas());
+    p_info->master.set_last_meas(master->get_last_meas());
+    p_info->master.set_meas_num(meas_num);
+  }
+
+  p_info->event_num = evels->get_Count();
+  p_info->unit_num = _unit_num;
+  for (int32_t u = 0; u < _unit_num; u++) {
+    p_name = _units[u]->get_name_buf(&size);
+    if (p_name && size > 0 && size <= pxtnMAX_TUNEUNITNAME)
+      memcpy(p_info->unit_names[u], p_name, size);
+  }
+  p_info->woice_num = _woice_num;
+  for (int32_t w = 0; w < _woice_num; w++) {
+    p_info->woice_types[w] = _woices[w]->get_type();
+    p_name = _woices[w]->get_name_buf(&size);
+    if (p_name && size > 0 && size <= pxtnMAX_TUNEWOICENAME)
+      memcpy(p_info->woice_names[w], p_name, size);
+  }
+
+  clear();
+  return pxtnOK;
+}
+
 // x1x project..------------------
 
 #define _MAX_PROJECTNAME_x1x 16
@@ -39,6 +39,19 @@ class pxtnService;
 
 typedef bool (* pxtnSampledCallback)( void* user, const pxtnService* pxtn );
 
+// what scan() finds in a project: its names, master and voice types.
+struct pxtnSCANINFO
+{
+	pxtnText      text     ;
+	pxtnMaster    master   ; // meas_num covers the last event, as after read().
+	int32_t       event_num;
+	int32_t       unit_num ;
+	int32_t       woice_num;
+	char          unit_names [ pxtnMAX_TUNEUNITSTRUCT  ][ pxtnMAX_TUNEUNITNAME  + 1 ];
+	pxtnWOICETYPE woice_types[ pxtnMAX_TUNEWOICESTRUCT ];
+	char          woice_names[ pxtnMAX_TUNEWOICESTRUCT ][ pxtnMAX_TUNEWOICENAME + 1 ];
+};
+
 class pxtnService
 {
 private:
@@ -63,6 +76,10 @@ private:
 
 	pxtnPulse_NoiseBuilder *_ptn_bldr;
 
+	pxtnDescriptor *_lazy_doc; // where read_lazy() left the woices' payloads.
+
+	char *_tone_cache_dir;
+
 	int32_t _delay_max;	int32_t _delay_num;	pxtnDelay     **_delays;
 	int32_t _ovdrv_max;	int32_t _ovdrv_num;	pxtnOverDrive **_ovdrvs;
 	int32_t _woice_max;	int32_t _woice_num;	pxtnWoice     **_woices;
@@ -71,12 +88,16 @@ private:
 	int32_t _group_num;
 
 	pxtnERR _ReadVersion      ( pxtnDescriptor *p_doc, _enum_FMTVER *p_fmt_ver, uint16_t *p_exe_ver );
-	pxtnERR _ReadTuneItems    ( pxtnDescriptor *p_doc );
+	pxtnERR _ReadTuneItems    ( pxtnDescriptor *p_doc, _enum_FMTVER fmt_ver );
 	bool    _x1x_Project_Read ( pxtnDescriptor *p_doc );
+	pxtnERR _scan_by_read     ( pxtnDescriptor *p_doc, pxtnSCANINFO *p_info );
+	pxtnERR _read             ( pxtnDescriptor *p_doc, bool b_lazy );
 
 	pxtnERR _io_Read_Delay    ( pxtnDescriptor *p_doc );
 	pxtnERR _io_Read_OverDrive( pxtnDescriptor *p_doc );
 	pxtnERR _io_Read_Woice    ( pxtnDescriptor *p_doc, pxtnWOICETYPE type );
+	pxtnERR _io_Load_Woice    ( int32_t idx );
+	pxtnERR _woice_ReadyTone  ( int32_t idx ); // loads it, and goes through the tone store and cache.
 	pxtnERR _io_Read_OldUnit  ( pxtnDescriptor *p_doc, int32_t ver        );
 
 	bool    _io_assiWOIC_w    ( pxtnDescriptor *p_doc, int32_t idx          ) const;
@@ -131,7 +152,6 @@ private:
 
 	pxtnERR _init           ( int32_t fix_evels_num, bool b_edit );
 	bool    _release        ();
-	pxtnERR _pre_count_event( pxtnDescriptor *p_doc, int32_t* p_count );
 
 
 	void _moo_constructor();
@@ -161,14 +181,29 @@ public :
 
 	pxtnERR write        ( pxtnDescriptor *p_doc, bool bTune, uint16_t exe_ver );
 	pxtnERR read         ( pxtnDescriptor *p_doc );
+	// like read(), but woices are only named; their payloads are read from p_doc when first
+	// needed (tones_ready(), Woice_ReadyTone(), write()), so p_doc must outlive that or clear().
+	pxtnERR read_lazy    ( pxtnDescriptor *p_doc );
+	pxtnERR scan         ( pxtnDescriptor *p_doc, pxtnSCANINFO *p_info ); // without loading events or voices.
+
+	// the project as parsed, saved for read_cache() (pxtnService_cache.cpp). src_hash is the
+	// pxtnService_cache_Hash() of the file it was read from. woices are loaded to be saved.
+	pxtnERR write_cache  ( pxtnDescriptor *p_doc, uint64_t src_hash );
+	// reloads a write_cache() without parsing; pxtnERR_cache_stale if it's from another file or
+	// version, pxtnERR_desc_broken if it was torn or cut short. woices load from p_doc as after read_lazy(), so it must outlive them.
+	pxtnERR read_cache   ( pxtnDescriptor *p_doc, uint64_t src_hash );
 
 	bool    AdjustMeasNum();
 
 	int32_t get_last_error_id() const;
 
-	pxtnERR tones_ready();
+	pxtnERR tones_ready(); // tones already made for a woice anywhere in the process are shared.
 	bool    tones_clear();
 
+	// keeps the tones tones_ready() and Woice_ReadyTone() make in dir, one file per distinct
+	// woice and sps, and reuses them from there. dir must exist; NULL stops (the default).
+	bool    set_tone_cache( const char *dir );
+
 	int32_t Group_Num () const;
 
 	// delay.
@@ -243,4 +278,7 @@ public :
 
 int32_t pxtnService_moo_CalcSampleNum( int32_t meas_num, int32_t beat_num, int32_t sps, float beat_tempo );
 
+// a fast, non-cryptographic hash of a project file, to tell whether a cache was made from it.
+uint64_t pxtnService_cache_Hash( const void *p, int32_t size );
+
 #endif
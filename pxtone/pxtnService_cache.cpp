@@ -0,0 +1,536 @@
+﻿
+// caches of what's slow to make again: parsed projects (.ptcache) and prepared tones (.pttone).
+// their layout is the machine's own (byte order, float format); a cache isn't meant to travel.
+
+#include "./pxtn.h"
+
+#include "./pxtnService.h"
+
+////////////////////////
+// project cache ///////
+////////////////////////
+
+// a project as read() leaves it, saved so it can be reloaded without parsing.
+//
+//   _CACHEHEAD
+//   the body (body_size bytes, hashed to body_hash):
+//   project name, comment                 (name_size, comment_size bytes; padded to 4)
+//   _CACHEDELAY x delay_num, _CACHEOVDRV x ovdrv_num
+//   _CACHEUNIT  x unit_num
+//   _CACHEWOICE + its mate chunk as in a project (from the size on; padded to 4) x woice_num
+//   EVECACHE    x event_num, in list order
+
+// bump when the layout or what read() leaves in the service changes.
+#define _CACHE_VERSION 1
+
+static const char _code_cache[ 8 ] = "PTCACHE";
+
+typedef struct
+{
+	char     code[ 8 ]   ;
+	uint32_t version     ;
+	uint32_t rec_size    ; // sizeof(EVECACHE)
+	uint64_t src_hash    ;
+	uint64_t body_hash   ; // a file torn by two writers is caught here.
+
+	int32_t  beat_num    ;
+	float    beat_tempo  ;
+	int32_t  beat_clock  ;
+	int32_t  meas_num    ;
+	int32_t  repeat_meas ;
+	int32_t  last_meas   ;
+
+	int32_t  name_size   ;
+	int32_t  comment_size;
+	int32_t  delay_num   ;
+	int32_t  ovdrv_num   ;
+	int32_t  unit_num    ;
+	int32_t  woice_num   ;
+	int32_t  event_num   ;
+	int32_t  body_size   ;
+}
+_CACHEHEAD;
+
+typedef struct
+{
+	int32_t unit ;
+	float   freq ;
+	float   rate ;
+	int32_t group;
+}
+_CACHEDELAY;
+
+typedef struct
+{
+	float   cut  ;
+	float   amp  ;
+	int32_t group;
+}
+_CACHEOVDRV;
+
+typedef struct
+{
+	int32_t name_size;
+	char    name_buf[ pxtnMAX_TUNEUNITNAME ];
+}
+_CACHEUNIT;
+
+typedef struct
+{
+	int32_t name_size;
+	char    name_buf[ pxtnMAX_TUNEWOICENAME ];
+	int32_t type     ;
+}
+_CACHEWOICE;
+
+static int32_t _pad( int32_t size ){ return ( 4 - ( size & 3 ) ) & 3; }
+
+static bool _w_pad( pxtnDescriptor *p_doc, int32_t size )
+{
+	static const char zero[ 4 ] = {0};
+	if( !_pad( size ) ) return true;
+	return p_doc->w_asfile( zero, 1, _pad( size ) );
+}
+
+// reads size bytes of text into a buffer of its own; *pp_buf is left NULL when there are none.
+static bool _r_text( pxtnDescriptor *p_doc, int32_t size, char **pp_buf )
+{
+	*pp_buf = NULL;
+	if( size <  0 ) return false;
+	if( size == 0 ) return true ;
+	if( !( *pp_buf = (char*)malloc( size ) ) ) return false;
+	if( !p_doc->r( *pp_buf, 1, size ) ) return false;
+	return p_doc->seek( pxtnSEEK_cur, _pad( size ) );
+}
+
+// hashes the next size bytes, which must be all that's left, and stays where it was.
+static pxtnERR _cache_BodyHash( pxtnDescriptor *p_doc, int32_t size, uint64_t *p_hash )
+{
+	int32_t        left   = 0;
+	const uint8_t* p_cur  = p_doc->get_p_cur( &left );
+	char*          p_body = NULL;
+
+	if( size < 0 ) return pxtnERR_desc_broken;
+
+	// straight from the mapping where there is one.
+	if( p_cur )
+	{
+		if( left != size ) return pxtnERR_desc_broken;
+		*p_hash = pxtnService_cache_Hash( p_cur, size );
+		return pxtnOK;
+	}
+
+	if( !size ){ *p_hash = pxtnService_cache_Hash( NULL, 0 ); return pxtnOK; }
+	if( !( p_body = (char*)malloc( size ) ) ) return pxtnERR_memory;
+	bool b_ret = p_doc->r( p_body, 1, size ) && p_doc->seek( pxtnSEEK_cur, -size );
+	if( b_ret ) *p_hash = pxtnService_cache_Hash( p_body, size );
+	free( p_body );
+	return b_ret ? pxtnOK : pxtnERR_desc_broken;
+}
+
+// the woice's mate chunk, from the size on.
+static pxtnERR _io_mate_w( const pxtnWoice *p_w, pxtnDescriptor *p_doc )
+{
+	bool b = false;
+	switch( p_w->get_type() )
+	{
+	case pxtnWOICE_PCM : b = p_w->io_matePCM_w ( p_doc ); break;
+	case pxtnWOICE_PTV : b = p_w->io_matePTV_w ( p_doc ); break;
+	case pxtnWOICE_PTN : b = p_w->io_matePTN_w ( p_doc ); break;
+#ifdef  pxINCLUDE_OGGVORBIS
+	case pxtnWOICE_OGGV: b = p_w->io_mateOGGV_w( p_doc ); break;
+#else
+	case pxtnWOICE_OGGV: return pxtnERR_ogg_no_supported;
+#endif
+	default            : return pxtnERR_inv_data;
+	}
+	return b ? pxtnOK : pxtnERR_desc_w;
+}
+
+pxtnERR pxtnService::write_cache( pxtnDescriptor *p_doc, uint64_t src_hash )
+{
+	if( !_b_init ) return pxtnERR_INIT;
+
+	pxtnERR        res       = pxtnERR_VOID;
+	_CACHEHEAD     head      = {0};
+	pxtnDescriptor body      ;
+	const char*    p_name    = text->get_name_buf   ( &head.name_size    );
+	const char*    p_comment = text->get_comment_buf( &head.comment_size );
+
+	memcpy( head.code, _code_cache, sizeof(head.code) );
+	head.version     = _CACHE_VERSION  ;
+	head.rec_size    = sizeof(EVECACHE);
+	head.src_hash    = src_hash        ;
+	master->Get( &head.beat_num, &head.beat_tempo, &head.beat_clock, &head.meas_num );
+	head.repeat_meas = master->get_repeat_meas();
+	head.last_meas   = master->get_last_meas  ();
+	head.delay_num   = _delay_num      ;
+	head.ovdrv_num   = _ovdrv_num      ;
+	head.unit_num    = _unit_num       ;
+	head.woice_num   = _woice_num      ;
+	head.event_num   = evels->get_Count();
+
+	// the body goes through memory first, for its hash.
+	if( !body.set_memory_w() ) return pxtnERR_memory;
+
+	if( head.name_size    && !body.w_asfile( p_name   , 1, head.name_size    ) ) return pxtnERR_desc_w;
+	if( !_w_pad( &body, head.name_size    ) ) return pxtnERR_desc_w;
+	if( head.comment_size && !body.w_asfile( p_comment, 1, head.comment_size ) ) return pxtnERR_desc_w;
+	if( !_w_pad( &body, head.comment_size ) ) return pxtnERR_desc_w;
+
+	for( int32_t i = 0; i < _delay_num; i++ )
+	{
+		_CACHEDELAY dela = {0};
+		dela.unit  = _delays[ i ]->get_unit ();
+		dela.freq  = _delays[ i ]->get_freq ();
+		dela.rate  = _delays[ i ]->get_rate ();
+		dela.group = _delays[ i ]->get_group();
+		if( !body.w_asfile( &dela, sizeof(dela), 1 ) ) return pxtnERR_desc_w;
+	}
+	for( int32_t i = 0; i < _ovdrv_num; i++ )
+	{
+		_CACHEOVDRV over = {0};
+		over.cut   = _ovdrvs[ i ]->get_cut  ();
+		over.amp   = _ovdrvs[ i ]->get_amp  ();
+		over.group = _ovdrvs[ i ]->get_group();
+		if( !body.w_asfile( &over, sizeof(over), 1 ) ) return pxtnERR_desc_w;
+	}
+	for( int32_t i = 0; i < _unit_num; i++ )
+	{
+		_CACHEUNIT  unit   = {0};
+		const char* p_buf  = _units[ i ]->get_name_buf( &unit.name_size );
+		memcpy( unit.name_buf, p_buf, unit.name_size );
+		if( !body.w_asfile( &unit, sizeof(unit), 1 ) ) return pxtnERR_desc_w;
+	}
+	for( int32_t i = 0; i < _woice_num; i++ )
+	{
+		const pxtnWoice* p_w   = _woices[ i ];
+		_CACHEWOICE      woice = {0};
+		const char*      p_buf = p_w->get_name_buf( &woice.name_size );
+		memcpy( woice.name_buf, p_buf, woice.name_size );
+		woice.type = p_w->get_type();
+		if( !body.w_asfile( &woice, sizeof(woice), 1 ) ) return pxtnERR_desc_w;
+
+		// woices still waiting in _lazy_doc go across as they are, without decoding them.
+		int32_t pos = body.tell();
+		if( p_w->is_lazy() ) res = p_w->io_mate_w_lazy( _lazy_doc, &body );
+		else                 res = _io_mate_w         ( p_w      , &body );
+		if( res != pxtnOK ) return res;
+		if( pos < 0 || !_w_pad( &body, body.tell() - pos ) ) return pxtnERR_desc_w;
+	}
+
+	for( const EVERECORD* p = evels->get_Records(); p; p = evels->get_Next( p ) )
+	{
+		EVECACHE rec = {0};
+		rec.clock   = p->clock  ;
+		rec.value   = p->value  ;
+		rec.unit_no = p->unit_no;
+		rec.kind    = p->kind   ;
+		if( !body.w_asfile( &rec, sizeof(rec), 1 ) ) return pxtnERR_desc_w;
+	}
+
+	head.body_size = body.get_size_bytes();
+	head.body_hash = pxtnService_cache_Hash( body.get_p_mem(), head.body_size );
+
+	if( !p_doc->w_asfile( &head, sizeof(head), 1 ) ) return pxtnERR_desc_w;
+	if( head.body_size && !p_doc->w_asfile( body.get_p_mem(), 1, head.body_size ) ) return pxtnERR_desc_w;
+	if( !p_doc->w_flush() ) return pxtnERR_desc_w;
+	return pxtnOK;
+}
+
+pxtnERR pxtnService::read_cache( pxtnDescriptor *p_doc, uint64_t src_hash )
+{
+	if( !_b_init ) return pxtnERR_INIT;
+
+	pxtnERR    res       = pxtnERR_VOID;
+	_CACHEHEAD head      = {0};
+	char*      p_name    = NULL;
+	char*      p_comment = NULL;
+	uint64_t   body_hash =    0;
+
+	clear();
+
+	if( !p_doc->r( &head, sizeof(head), 1 ) ){ res = pxtnERR_desc_r; goto term; }
+	if( memcmp( head.code, _code_cache, sizeof(head.code) ) ||
+		head.version  != _CACHE_VERSION                      ||
+		head.rec_size != sizeof(EVECACHE)                    ||
+		head.src_hash != src_hash                            ){ res = pxtnERR_cache_stale; goto term; }
+
+	res = _cache_BodyHash( p_doc, head.body_size, &body_hash ); if( res != pxtnOK ) goto term;
+	if( body_hash != head.body_hash ){ res = pxtnERR_desc_broken; goto term; }
+
+	if( head.delay_num < 0 || head.delay_num > _delay_max ||
+		head.ovdrv_num < 0 || head.ovdrv_num > _ovdrv_max ||
+		head.unit_num  < 0 || head.unit_num  > _unit_max  ||
+		head.woice_num < 0 || head.woice_num > _woice_max ||
+		head.event_num < 0                                ){ res = pxtnERR_fmt_unknown; goto term; }
+
+	master->Set( head.beat_num, head.beat_tempo, head.beat_clock );
+	master->set_repeat_meas( head.repeat_meas );
+	master->set_last_meas  ( head.last_meas   );
+	master->set_meas_num   ( head.meas_num    ); // checked against the two above.
+
+	if( !_r_text( p_doc, head.name_size   , &p_name    ) ){ res = pxtnERR_desc_r; goto term; }
+	if( !_r_text( p_doc, head.comment_size, &p_comment ) ){ res = pxtnERR_desc_r; goto term; }
+	if( p_name    && !text->set_name_buf   ( p_name   , head.name_size    ) ){ res = pxtnERR_memory; goto term; }
+	if( p_comment && !text->set_comment_buf( p_comment, head.comment_size ) ){ res = pxtnERR_memory; goto term; }
+
+	for( int32_t i = 0; i < head.delay_num; i++ )
+	{
+		_CACHEDELAY dela = {0};
+		if( !p_doc->r( &dela, sizeof(dela), 1 ) ){ res = pxtnERR_desc_r; goto term; }
+		if( dela.unit < 0 || dela.unit >= DELAYUNIT_num ){ res = pxtnERR_fmt_unknown; goto term; }
+		Delay_Add( (DELAYUNIT)dela.unit, dela.freq, dela.rate, dela.group );
+	}
+	for( int32_t i = 0; i < head.ovdrv_num; i++ )
+	{
+		_CACHEOVDRV over = {0};
+		if( !p_doc->r( &over, sizeof(over), 1 ) ){ res = pxtnERR_desc_r; goto term; }
+		OverDrive_Add( over.cut, over.amp, over.group );
+	}
+	for( int32_t i = 0; i < head.unit_num; i++ )
+	{
+		_CACHEUNIT unit = {0};
+		if( !p_doc->r( &unit, sizeof(unit), 1 ) ){ res = pxtnERR_desc_r; goto term; }
+		if( !Unit_AddNew() ){ res = pxtnERR_memory; goto term; }
+		if( !_units[ _unit_num - 1 ]->set_name_buf( unit.name_buf, unit.name_size ) ){ res = pxtnERR_fmt_unknown; goto term; }
+	}
+
+	// the woices stay in the cache until they're needed, as after read_lazy().
+	_lazy_doc = p_doc;
+	for( int32_t i = 0; i < head.woice_num; i++ )
+	{
+		_CACHEWOICE woice = {0};
+		if( !p_doc->r( &woice, sizeof(woice), 1 ) ){ res = pxtnERR_desc_r; goto term; }
+		if( woice.type <= pxtnWOICE_None || woice.type > pxtnWOICE_OGGV ){ res = pxtnERR_fmt_unknown; goto term; }
+
+		int32_t pos = p_doc->tell();
+		res = _io_Read_Woice( p_doc, (pxtnWOICETYPE)woice.type ); if( res != pxtnOK ) goto term;
+		if( !_woices[ _woice_num - 1 ]->set_name_buf( woice.name_buf, woice.name_size ) ){ res = pxtnERR_fmt_unknown; goto term; }
+		if( !p_doc->seek( pxtnSEEK_cur, _pad( p_doc->tell() - pos ) ) ){ res = pxtnERR_desc_r; goto term; }
+	}
+
+	if( !_b_fix_evels_num )
+	{
+		if( !evels->Allocate( head.event_num > 0 ? head.event_num : 1, true ) ){ res = pxtnERR_memory; goto term; }
+	}
+	evels->Linear_Start();
+	{
+		// straight from the mapping where there is one.
+		int32_t         left   = 0;
+		const uint8_t*  p_recs = p_doc->get_p_cur( &left );
+		if( p_recs )
+		{
+			if( left / (int32_t)sizeof(EVECACHE) < head.event_num ){ res = pxtnERR_desc_r; goto term; }
+			if( !evels->Linear_Add_Cache( (const EVECACHE*)p_recs, head.event_num ) ){ res = _b_fix_evels_num ? pxtnERR_too_much_event : pxtnERR_memory; goto term; }
+		}
+		else
+		{
+			EVECACHE recs[ 256 ];
+			for( int32_t e = 0; e < head.event_num; e += 256 )
+			{
+				int32_t num = head.event_num - e < 256 ? head.event_num - e : 256;
+				if( !p_doc->r( recs, sizeof(EVECACHE), num ) ){ res = pxtnERR_desc_r; goto term; }
+				if( !evels->Linear_Add_Cache( recs, num ) ){ res = _b_fix_evels_num ? pxtnERR_too_much_event : pxtnERR_memory; goto term; }
+			}
+		}
+	}
+	evels->Linear_End( true );
+
+	_moo_b_valid_data = true;
+	res = pxtnOK;
+term:
+	if( p_name    ) free( p_name    );
+	if( p_comment ) free( p_comment );
+	if( res != pxtnOK ) clear();
+	return res;
+}
+
+////////////////////////
+// tone cache //////////
+////////////////////////
+
+// a woice's prepared tones, in <dir>/<key>.pttone. the key hashes the woice's mate chunk
+// (PCM bytes, ptnoise design, ptvoice waves and envelopes...) and the sps.
+//
+//   _TONEHEAD
+//   the woice's io_Tone_w() (body_size bytes, hashed to body_hash)
+
+// bump when the layout or how tones are made changes.
+#define _TONE_VERSION 1
+
+static const char _code_tone[ 8 ] = "PTTONE";
+
+typedef struct
+{
+	char     code[ 8 ];
+	uint32_t version  ;
+	int32_t  body_size;
+	uint64_t key      ;
+	uint64_t body_hash; // a file torn by two writers is caught here.
+}
+_TONEHEAD;
+
+bool pxtnService::set_tone_cache( const char *dir )
+{
+	free( _tone_cache_dir ); _tone_cache_dir = NULL;
+	if( !dir ) return true;
+	if( !( _tone_cache_dir = (char*)malloc( strlen( dir ) + 1 ) ) ) return false;
+	strcpy( _tone_cache_dir, dir );
+	return true;
+}
+
+static pxtnERR _tone_Key( const pxtnWoice *p_w, int32_t sps, uint64_t *p_key )
+{
+	pxtnERR        res  = pxtnERR_VOID;
+	pxtnDescriptor desc;
+	int32_t        type = p_w->get_type();
+
+	if( !desc.set_memory_w()                        ) return pxtnERR_memory;
+	if( !desc.w_asfile( &type, sizeof(int32_t), 1 ) ) return pxtnERR_desc_w;
+	if( !desc.w_asfile( &sps , sizeof(int32_t), 1 ) ) return pxtnERR_desc_w;
+	res = _io_mate_w( p_w, &desc ); if( res != pxtnOK ) return res;
+
+	*p_key = pxtnService_cache_Hash( desc.get_p_mem(), desc.get_size_bytes() );
+	return pxtnOK;
+}
+
+static pxtnERR _tone_Read( pxtnWoice *p_w, const char *path, uint64_t key )
+{
+	pxtnERR   res    = pxtnERR_VOID;
+	_TONEHEAD head   = {0};
+	char*     p_body = NULL;
+	FILE*     fp     = fopen( path, "rb" );
+
+	if( !fp ) return pxtnERR_desc_r;
+	{
+		pxtnDescriptor desc;
+		pxtnDescriptor body;
+		int32_t        left   = 0;
+		const uint8_t* p_cur  = NULL;
+
+		if( !desc.set_file_map_r( fp ) && !desc.set_file_r( fp ) ){ res = pxtnERR_desc_r; goto term; }
+		if( !desc.r( &head, sizeof(head), 1 ) ){ res = pxtnERR_desc_r; goto term; }
+		if( memcmp( head.code, _code_tone, sizeof(head.code) ) ||
+			head.version != _TONE_VERSION || head.key != key || head.body_size < 1 ){ res = pxtnERR_cache_stale; goto term; }
+
+		// straight from the mapping where there is one.
+		if( ( p_cur = desc.get_p_cur( &left ) ) )
+		{
+			if( left != head.body_size ){ res = pxtnERR_desc_broken; goto term; }
+		}
+		else
+		{
+			if( !( p_body = (char*)malloc( head.body_size ) ) ){ res = pxtnERR_memory; goto term; }
+			if( !desc.r( p_body, 1, head.body_size ) ){ res = pxtnERR_desc_r; goto term; }
+			p_cur = (const uint8_t*)p_body;
+		}
+		if( pxtnService_cache_Hash( p_cur, head.body_size ) != head.body_hash ){ res = pxtnERR_desc_broken; goto term; }
+
+		if( !body.set_memory_r( (void*)p_cur, head.body_size ) ){ res = pxtnERR_desc_r; goto term; }
+		res = p_w->io_Tone_r( &body );
+	}
+term:
+	if( p_body ) free( p_body );
+	fclose( fp );
+	return res;
+}
+
+// best effort: a tone that can't be saved is made again next time.
+static void _tone_Write( const pxtnWoice *p_w, const char *path, uint64_t key )
+{
+	_TONEHEAD      head = {0};
+	pxtnDescriptor body;
+	char*          tmp  = NULL;
+	FILE*          fp   = NULL;
+	bool           b_ok = false;
+
+	if( !body.set_memory_w() || !p_w->io_Tone_w( &body ) ) return;
+
+	memcpy( head.code, _code_tone, sizeof(head.code) );
+	head.version   = _TONE_VERSION;
+	head.body_size = body.get_size_bytes();
+	head.key       = key;
+	head.body_hash = pxtnService_cache_Hash( body.get_p_mem(), head.body_size );
+
+	// written aside and renamed over, so readers never see half a file.
+	if( !( tmp = (char*)malloc( strlen( path ) + 5 ) ) ) return;
+	sprintf( tmp, "%s.tmp", path );
+	if( ( fp = fopen( tmp, "wb" ) ) )
+	{
+		b_ok = fwrite( &head, sizeof(head), 1, fp ) == 1 &&
+			   fwrite( body.get_p_mem(), 1, head.body_size, fp ) == (size_t)head.body_size;
+		if( fclose( fp ) ) b_ok = false;
+		if( !b_ok || rename( tmp, path ) ) remove( tmp );
+	}
+	free( tmp );
+}
+
+pxtnERR pxtnService::_woice_ReadyTone( int32_t idx )
+{
+	pxtnERR    res  = pxtnERR_VOID;
+	pxtnWoice* p_w  = _woices[ idx ];
+	uint64_t   key  = 0;
+	char*      path = NULL;
+
+	res = _io_Load_Woice( idx ); if( res != pxtnOK ) return res;
+
+	if( _tone_Key( p_w, _dst_sps, &key ) != pxtnOK ) return p_w->Tone_Ready( _ptn_bldr, _dst_sps );
+
+	// already made by a woice somewhere in the process.
+	if( p_w->Tone_Attach( key ) ) return pxtnOK;
+
+	if( !_tone_cache_dir )
+	{
+		res = p_w->Tone_Ready( _ptn_bldr, _dst_sps );
+	}
+	else
+	{
+		if( !( path = (char*)malloc( strlen( _tone_cache_dir ) + 32 ) ) ) return pxtnERR_memory;
+		sprintf( path, "%s/%016llx.pttone", _tone_cache_dir, (unsigned long long)key );
+
+		if( _tone_Read( p_w, path, key ) != pxtnOK )
+		{
+			res = p_w->Tone_Ready( _ptn_bldr, _dst_sps );
+			if( res == pxtnOK ) _tone_Write( p_w, path, key );
+		}
+		else
+		{
+			res = pxtnOK;
+		}
+		free( path );
+	}
+
+	if( res == pxtnOK ) p_w->Tone_Share( key );
+	return res;
+}
+
+// one 64-bit lane of MurmurHash3, over the file 8 bytes at a time.
+static uint64_t _rotl( uint64_t v, int r ){ return ( v << r ) | ( v >> ( 64 - r ) ); }
+
+uint64_t pxtnService_cache_Hash( const void *p, int32_t size )
+{
+	const uint8_t* p_src = (const uint8_t*)p;
+	uint64_t       h     = (uint64_t)size;
+	uint64_t       k     = 0;
+	int32_t        i     = 0;
+
+	for( ; i <= size - 8; i += 8 )
+	{
+		memcpy( &k, p_src + i, 8 );
+		k *= 0x87c37b91114253d5ULL; k = _rotl( k, 31 ); k *= 0x4cf5ad432745937fULL;
+		h ^= k; h = _rotl( h, 27 ) * 5 + 0x52dce729;
+	}
+	if( i < size )
+	{
+		k = 0;
+		memcpy( &k, p_src + i, size - i );
+		k *= 0x87c37b91114253d5ULL; k = _rotl( k, 31 ); k *= 0x4cf5ad432745937fULL;
+		h ^= k;
+	}
+
+	h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
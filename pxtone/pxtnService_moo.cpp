@@ -116,7 +116,7 @@ bool pxtnService::_moo_PXTONE_SAMPLE( void *p_data )
 	int32_t  clock = (int32_t)( _moo_smp_count / _moo_clock_rate );
 
 	// events..
-	for( ; _moo_p_eve && _moo_p_eve->clock <= clock; _moo_p_eve = _moo_p_eve->next )
+	for( ; _moo_p_eve && _moo_p_eve->clock <= clock; _moo_p_eve = evels->get_Next( _moo_p_eve ) )
 	{
 		int32_t                  u   = _moo_p_eve->unit_no;
 		pxtnUnit*                p_u = _units[ u ];
@@ -145,8 +145,8 @@ bool pxtnService::_moo_PXTONE_SAMPLE( void *p_data )
 						int32_t        max_life_count1 = (int32_t)( ( _moo_p_eve->value - ( clock - _moo_p_eve->clock ) ) * _moo_clock_rate ) + p_vi->env_release;
 						int32_t        max_life_count2;
 						int32_t        c    = _moo_p_eve->clock + _moo_p_eve->value + p_tone->env_release_clock;
-						EVERECORD* next = NULL;
-						for( EVERECORD* p = _moo_p_eve->next; p; p = p->next )
+						const EVERECORD* next = NULL;
+						for( const EVERECORD* p = evels->get_Next( _moo_p_eve ); p; p = evels->get_Next( p ) )
 						{
 							if( p->clock > c ) break;
 							if( p->unit_no == u && p->kind == EVENTKIND_ON ){ next = p; break; }
@@ -1,5 +1,7 @@
 ﻿// '12/03/03
 
+#include <mutex>
+
 #include "./pxtn.h"
 
 #include "./pxtnWoice.h"
@@ -15,6 +17,8 @@ pxtnWoice::pxtnWoice()
 	_type      = pxtnWOICE_None;
 	_voices    = NULL          ;
 	_voinsts   = NULL          ;
+	_lazy_pos  =             -1;
+	_p_shared  = NULL          ;
 }
 
 pxtnWoice::~pxtnWoice()
@@ -26,6 +30,8 @@ int32_t       pxtnWoice::get_voice_num    () const{ return _voice_num    ; }
 int32_t       pxtnWoice::get_x3x_basic_key() const{ return _x3x_basic_key; }
 float         pxtnWoice::get_x3x_tuning   () const{ return _x3x_tuning   ; }
 pxtnWOICETYPE pxtnWoice::get_type         () const{ return _type         ; }
+bool          pxtnWoice::is_lazy          () const{ return _lazy_pos >= 0; }
+bool          pxtnWoice::is_tone_shared   () const{ return _p_shared != NULL; }
 
 
 pxtnVOICEUNIT *pxtnWoice::get_voice_variable( int32_t idx )
@@ -87,14 +93,17 @@ static void _Voice_Release( pxtnVOICEUNIT* p_vc, pxtnVOICEINSTANCE* p_vi )
 
 void pxtnWoice::Voice_Release ()
 {
+	_Tone_Unshare( false );
 	for( int32_t v = 0; v < _voice_num; v++ ) _Voice_Release( &_voices[ v ], &_voinsts[ v ] );
 	pxtnMem_free( (void**)&_voices  );
 	pxtnMem_free( (void**)&_voinsts );
 	_voice_num = 0;
+	_lazy_pos  = -1; // whatever replaces the voices isn't the skipped chunk.
 }
 
 void pxtnWoice::Slim()
 {
+	_Tone_Unshare( true );
 	for( int32_t i = _voice_num - 1; i >= 0; i-- )
 	{
 		bool b_remove = false;
@@ -158,7 +167,8 @@ bool pxtnWoice::Copy( pxtnWoice *p_dst ) const
 
 	if( !p_dst->Voice_Allocate( _voice_num ) ) goto End;
 
-	p_dst->_type = _type;
+	p_dst->_type     = _type    ;
+	p_dst->_lazy_pos = _lazy_pos; // still to be loaded from the same document.
 
 	memcpy( p_dst->_name_buf, _name_buf, sizeof(_name_buf) );
 	p_dst->_name_size = _name_size;
@@ -337,6 +347,8 @@ pxtnERR pxtnWoice::Tone_Ready_sample( const pxtnPulse_NoiseBuilder *ptn_bldr )
 	int32_t            sps   = 44100;
 	int32_t            bps   =    16;
 
+	_Tone_Unshare( true );
+
 	for( int32_t v = 0; v < _voice_num; v++ )
 	{
 		p_vi = &_voinsts[ v ];
@@ -424,6 +436,8 @@ pxtnERR pxtnWoice::Tone_Ready_envelope( int32_t sps )
 	int32_t    e       =            0;
 	pxtnPOINT* p_point = NULL        ;
 
+	_Tone_Unshare( true );
+
 	for( int32_t v = 0; v < _voice_num; v++ )
 	{
 		pxtnVOICEINSTANCE* p_vi   = &_voinsts[ v ] ;
@@ -506,7 +520,236 @@ term:
 pxtnERR pxtnWoice::Tone_Ready( const pxtnPulse_NoiseBuilder *ptn_bldr, int32_t sps )
 {
 	pxtnERR res = pxtnERR_VOID;
+	_Tone_Unshare( false ); // both are made again.
 	res = Tone_Ready_sample  ( ptn_bldr ); if( res != pxtnOK ) return res;
 	res = Tone_Ready_envelope( sps      ); if( res != pxtnOK ) return res;
 	return pxtnOK;
 }
+
+////////////////////////
+// tone cache //////////
+////////////////////////
+
+// 2ch 16bit, as Tone_Ready_sample() makes them.
+#define _TONE_BYTEPERSMP 4
+
+// per voice, followed by its smp_size bytes of samples and env_bytes bytes of envelope.
+typedef struct
+{
+	int32_t smp_head_w ;
+	int32_t smp_body_w ;
+	int32_t smp_tail_w ;
+	int32_t smp_size   ;
+	int32_t env_size   ;
+	int32_t env_bytes  ; // 0 without an envelope; env_size may still be set.
+	int32_t env_release;
+}
+_TONESTRUCT;
+
+bool pxtnWoice::io_Tone_w( pxtnDescriptor *p_doc ) const
+{
+	if( !p_doc->w_asfile( &_voice_num, sizeof(int32_t), 1 ) ) return false;
+
+	for( int32_t v = 0; v < _voice_num; v++ )
+	{
+		const pxtnVOICEINSTANCE* p_vi = &_voinsts[ v ];
+		_TONESTRUCT              tone = {0};
+
+		tone.smp_head_w  = p_vi->smp_head_w ;
+		tone.smp_body_w  = p_vi->smp_body_w ;
+		tone.smp_tail_w  = p_vi->smp_tail_w ;
+		tone.smp_size    = p_vi->p_smp_w ? ( p_vi->smp_head_w + p_vi->smp_body_w + p_vi->smp_tail_w ) * _TONE_BYTEPERSMP : 0;
+		tone.env_size    = p_vi->env_size   ;
+		tone.env_bytes   = p_vi->p_env ? p_vi->env_size : 0;
+		tone.env_release = p_vi->env_release;
+
+		if( !p_doc->w_asfile( &tone, sizeof(tone), 1 ) ) return false;
+		if( tone.smp_size  && !p_doc->w_asfile( p_vi->p_smp_w, 1, tone.smp_size  ) ) return false;
+		if( tone.env_bytes && !p_doc->w_asfile( p_vi->p_env  , 1, tone.env_bytes ) ) return false;
+	}
+	return true;
+}
+
+pxtnERR pxtnWoice::io_Tone_r( pxtnDescriptor *p_doc )
+{
+	pxtnERR res = pxtnERR_VOID;
+	int32_t num =            0;
+
+	if( !p_doc->r( &num, sizeof(int32_t), 1 ) ) return pxtnERR_desc_r;
+	if( num != _voice_num                      ) return pxtnERR_inv_data;
+
+	_Tone_Unshare( false );
+	for( int32_t v = 0; v < _voice_num; v++ )
+	{
+		pxtnMem_free( (void**)&_voinsts[ v ].p_smp_w );
+		pxtnMem_free( (void**)&_voinsts[ v ].p_env   );
+	}
+
+	for( int32_t v = 0; v < _voice_num; v++ )
+	{
+		pxtnVOICEINSTANCE* p_vi = &_voinsts[ v ];
+		_TONESTRUCT        tone = {0};
+
+		if( !p_doc->r( &tone, sizeof(tone), 1 ) ){ res = pxtnERR_desc_r; goto term; }
+		if( tone.smp_head_w < 0 || tone.smp_body_w < 0 || tone.smp_tail_w < 0 ||
+			tone.env_size   < 0 || tone.env_release < 0                        ||
+			( tone.smp_size  && tone.smp_size  != ( tone.smp_head_w + tone.smp_body_w + tone.smp_tail_w ) * _TONE_BYTEPERSMP ) ||
+			( tone.env_bytes && tone.env_bytes != tone.env_size ) ){ res = pxtnERR_inv_data; goto term; }
+
+		if( tone.smp_size )
+		{
+			if( !( p_vi->p_smp_w = (uint8_t*)malloc( tone.smp_size ) ) ){ res = pxtnERR_memory; goto term; }
+			if( !p_doc->r( p_vi->p_smp_w, 1, tone.smp_size ) ){ res = pxtnERR_desc_r; goto term; }
+		}
+		if( tone.env_bytes )
+		{
+			if( !( p_vi->p_env = (uint8_t*)malloc( tone.env_bytes ) ) ){ res = pxtnERR_memory; goto term; }
+			if( !p_doc->r( p_vi->p_env, 1, tone.env_bytes ) ){ res = pxtnERR_desc_r; goto term; }
+		}
+		p_vi->smp_head_w  = tone.smp_head_w ;
+		p_vi->smp_body_w  = tone.smp_body_w ;
+		p_vi->smp_tail_w  = tone.smp_tail_w ;
+		p_vi->env_size    = tone.env_size   ;
+		p_vi->env_release = tone.env_release;
+	}
+
+	res = pxtnOK;
+term:
+	if( res != pxtnOK )
+	{
+		for( int32_t v = 0; v < _voice_num; v++ )
+		{
+			pxtnMem_free( (void**)&_voinsts[ v ].p_smp_w );
+			pxtnMem_free( (void**)&_voinsts[ v ].p_env   );
+		}
+	}
+	return res;
+}
+
+////////////////////////
+// shared tones ////////
+////////////////////////
+
+struct pxtnTONESHARED
+{
+	uint64_t           key      ;
+	int32_t            ref      ;
+	int32_t            voice_num;
+	pxtnVOICEINSTANCE* voinsts  ; // the buffers are the entry's.
+	pxtnTONESHARED*    next     ;
+};
+
+#define _TONESTORE_BUCKETNUM 256
+
+static pxtnTONESHARED* _tone_store[ _TONESTORE_BUCKETNUM ];
+static std::mutex      _tone_store_mutex;
+
+// the link to the key's entry, or to where it would go. under the mutex.
+static pxtnTONESHARED** _tone_store_Find( uint64_t key )
+{
+	pxtnTONESHARED** pp = &_tone_store[ key % _TONESTORE_BUCKETNUM ];
+	while( *pp && (*pp)->key != key ) pp = &(*pp)->next;
+	return pp;
+}
+
+static void _tone_store_Release( pxtnTONESHARED* p )
+{
+	{
+		std::lock_guard<std::mutex> lock( _tone_store_mutex );
+		if( --p->ref ) return;
+		pxtnTONESHARED** pp = _tone_store_Find( p->key );
+		*pp = p->next;
+	}
+	for( int32_t v = 0; v < p->voice_num; v++ )
+	{
+		pxtnMem_free( (void**)&p->voinsts[ v ].p_smp_w );
+		pxtnMem_free( (void**)&p->voinsts[ v ].p_env   );
+	}
+	free( p->voinsts );
+	free( p );
+}
+
+// lets go of the store entry. b_keep keeps a copy of its tones to change, else they're dropped.
+void pxtnWoice::_Tone_Unshare( bool b_keep )
+{
+	if( !_p_shared ) return;
+
+	for( int32_t v = 0; v < _voice_num; v++ )
+	{
+		pxtnVOICEINSTANCE* p_vi  = &_voinsts[ v ];
+		const uint8_t*     p_smp = p_vi->p_smp_w;
+		const uint8_t*     p_env = p_vi->p_env  ;
+		int32_t            size  = ( p_vi->smp_head_w + p_vi->smp_body_w + p_vi->smp_tail_w ) * _TONE_BYTEPERSMP;
+
+		p_vi->p_smp_w = NULL;
+		p_vi->p_env   = NULL;
+		if( !b_keep ) continue;
+		if( p_smp && ( p_vi->p_smp_w = (uint8_t*)malloc( size           ) ) ) memcpy( p_vi->p_smp_w, p_smp, size           );
+		if( p_env && ( p_vi->p_env   = (uint8_t*)malloc( p_vi->env_size ) ) ) memcpy( p_vi->p_env  , p_env, p_vi->env_size );
+	}
+	_tone_store_Release( _p_shared );
+	_p_shared = NULL;
+}
+
+bool pxtnWoice::Tone_Attach( uint64_t key )
+{
+	pxtnTONESHARED* p = NULL;
+	{
+		std::lock_guard<std::mutex> lock( _tone_store_mutex );
+		p = *_tone_store_Find( key );
+		if( !p || p->voice_num != _voice_num ) return false;
+		p->ref++;
+	}
+
+	_Tone_Unshare( false );
+	for( int32_t v = 0; v < _voice_num; v++ )
+	{
+		pxtnMem_free( (void**)&_voinsts[ v ].p_smp_w );
+		pxtnMem_free( (void**)&_voinsts[ v ].p_env   );
+		_voinsts[ v ] = p->voinsts[ v ];
+	}
+	_p_shared = p;
+	return true;
+}
+
+void pxtnWoice::Tone_Share( uint64_t key )
+{
+	pxtnTONESHARED* p     = NULL ;
+	bool            b_new = false;
+
+	if( _p_shared || !_voice_num ) return;
+	{
+		std::lock_guard<std::mutex> lock( _tone_store_mutex );
+		pxtnTONESHARED** pp = _tone_store_Find( key );
+		if( *pp )
+		{
+			// made twice at once; ours go.
+			if( (*pp)->voice_num != _voice_num ) return;
+			p = *pp;
+			p->ref++;
+		}
+		else
+		{
+			if( !( p = (pxtnTONESHARED*)malloc( sizeof(pxtnTONESHARED) ) ) ) return;
+			if( !( p->voinsts = (pxtnVOICEINSTANCE*)malloc( sizeof(pxtnVOICEINSTANCE) * _voice_num ) ) ){ free( p ); return; }
+			memcpy( p->voinsts, _voinsts, sizeof(pxtnVOICEINSTANCE) * _voice_num );
+			p->key       = key       ;
+			p->ref       = 1         ;
+			p->voice_num = _voice_num;
+			p->next      = NULL      ;
+			*pp   = p   ;
+			b_new = true;
+		}
+	}
+
+	if( !b_new )
+	{
+		for( int32_t v = 0; v < _voice_num; v++ )
+		{
+			pxtnMem_free( (void**)&_voinsts[ v ].p_smp_w );
+			pxtnMem_free( (void**)&_voinsts[ v ].p_env   );
+			_voinsts[ v ] = p->voinsts[ v ];
+		}
+	}
+	_p_shared = p;
+}
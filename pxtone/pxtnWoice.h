@@ -115,6 +115,8 @@ typedef struct
 pxtnVOICETONE;
 
 
+struct pxtnTONESHARED;
+
 class pxtnWoice
 {
 private:
@@ -133,6 +135,12 @@ private:
 	float              _x3x_tuning   ;
 	int32_t            _x3x_basic_key; // tuning old-fmt when key-event
 
+	int32_t            _lazy_pos     ; // where io_mate_r_lazy() left the chunk, -1 once it's read.
+
+	pxtnTONESHARED*    _p_shared     ; // the tones in _voinsts are this store entry's, not ours.
+
+	void _Tone_Unshare( bool b_keep );
+
 public :
 	 pxtnWoice();
 	~pxtnWoice();
@@ -152,6 +160,7 @@ public :
 
 	bool Voice_Allocate( int32_t voice_num );
 	void Voice_Release ();
+	// a lazy woice copies as lazy: p_dst loads from the same document.
 	bool Copy( pxtnWoice *p_dst ) const;
 	void Slim();
 
@@ -174,9 +183,27 @@ public :
 	pxtnERR io_mateOGGV_r( pxtnDescriptor *p_doc );
 #endif
 
+	// skips a mate chunk, noting where it is; the woice keeps only its type until io_mate_load().
+	pxtnERR io_mate_r_lazy( pxtnDescriptor *p_doc, pxtnWOICETYPE type );
+	// reads the chunk skipped by io_mate_r_lazy() from the same document. does nothing otherwise.
+	pxtnERR io_mate_load  ( pxtnDescriptor *p_doc );
+	// copies that chunk, size and all, from p_src to p_dst as it is, without decoding it.
+	pxtnERR io_mate_w_lazy( pxtnDescriptor *p_src, pxtnDescriptor *p_dst ) const;
+	bool    is_lazy       () const;
+
 	pxtnERR Tone_Ready_sample  ( const pxtnPulse_NoiseBuilder *ptn_bldr  );
 	pxtnERR Tone_Ready_envelope( int32_t sps );
 	pxtnERR Tone_Ready         ( const pxtnPulse_NoiseBuilder *ptn_bldr, int32_t sps );
+
+	// the tones Tone_Ready() made, as a tone cache keeps them.
+	bool    io_Tone_w( pxtnDescriptor *p_doc ) const;
+	pxtnERR io_Tone_r( pxtnDescriptor *p_doc );
+
+	// a process-wide store of prepared tones, shared read-only by the woices whose tones have
+	// the same key; an entry goes with the last woice using it.
+	bool Tone_Attach   ( uint64_t key ); // takes the tones from the store, if they're in it.
+	void Tone_Share    ( uint64_t key ); // hands the tones Tone_Ready() made to the store.
+	bool is_tone_shared() const;
 };
 
 #endif
@@ -300,3 +300,68 @@ End:
 }
 
 #endif
+
+////////////////////////
+// lazy mate ///////////
+////////////////////////
+
+pxtnERR pxtnWoice::io_mate_r_lazy( pxtnDescriptor *p_doc, pxtnWOICETYPE type )
+{
+	int32_t pos  = p_doc->tell();
+	int32_t size =             0;
+
+	if( pos < 0                                        ) return pxtnERR_desc_r;
+	if( !p_doc->r( &size, sizeof(int32_t), 1 )         ) return pxtnERR_desc_r;
+	if( size < 0 || !p_doc->seek( pxtnSEEK_cur, size ) ) return pxtnERR_desc_r;
+
+	Voice_Release();
+	_type     = type;
+	_lazy_pos = pos ;
+	return pxtnOK;
+}
+
+pxtnERR pxtnWoice::io_mate_load( pxtnDescriptor *p_doc )
+{
+	pxtnERR res = pxtnERR_VOID;
+	int32_t pos = _lazy_pos;
+
+	if( pos < 0 ) return pxtnOK;
+	if( !p_doc->seek( pxtnSEEK_set, pos ) ) return pxtnERR_desc_r;
+
+	switch( _type )
+	{
+	case pxtnWOICE_PCM : res = io_matePCM_r ( p_doc ); break;
+	case pxtnWOICE_PTV : res = io_matePTV_r ( p_doc ); break;
+	case pxtnWOICE_PTN : res = io_matePTN_r ( p_doc ); break;
+#ifdef  pxINCLUDE_OGGVORBIS
+	case pxtnWOICE_OGGV: res = io_mateOGGV_r( p_doc ); break;
+#else
+	case pxtnWOICE_OGGV: res = pxtnERR_ogg_no_supported; break;
+#endif
+	default            : res = pxtnERR_fmt_unknown     ; break;
+	}
+	// reading released the voices, and with them where the chunk is.
+	_lazy_pos = ( res == pxtnOK ) ? -1 : pos;
+	return res;
+}
+
+pxtnERR pxtnWoice::io_mate_w_lazy( pxtnDescriptor *p_src, pxtnDescriptor *p_dst ) const
+{
+	int32_t size =   0;
+	char    buf[ 4096 ];
+
+	if( _lazy_pos < 0                                 ) return pxtnERR_inv_data;
+	if( !p_src->seek( pxtnSEEK_set, _lazy_pos )       ) return pxtnERR_desc_r;
+	if( !p_src->r( &size, sizeof(int32_t), 1 )        ) return pxtnERR_desc_r;
+	if( size < 0                                      ) return pxtnERR_desc_broken;
+	if( !p_dst->w_asfile( &size, sizeof(int32_t), 1 ) ) return pxtnERR_desc_w;
+
+	while( size > 0 )
+	{
+		int32_t part = size < (int32_t)sizeof(buf) ? size : (int32_t)sizeof(buf);
+		if( !p_src->r      ( buf, 1, part ) ) return pxtnERR_desc_r;
+		if( !p_dst->w_asfile( buf, 1, part ) ) return pxtnERR_desc_w;
+		size -= part;
+	}
+	return pxtnOK;
+}
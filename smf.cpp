@@ -0,0 +1,103 @@
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+#include "smf.hpp"
+
+bool FileSink::write(const void *data, size_t size) {
+  return fwrite(data, 1, size, file) == size;
+}
+
+#ifndef _WIN32
+bool FdSink::write(const void *data, size_t size) {
+  const char *p = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t written = ::write(fd, p, size);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    p += written;
+    size -= written;
+  }
+  return true;
+}
+#endif
+
+bool MemorySink::write(const void *data, size_t size) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  buffer.insert(buffer.end(), p, p + size);
+  return true;
+}
+
+static void put_be(std::vector<uint8_t> &out, uint32_t value, int bytes) {
+  for (int i = bytes - 1; i >= 0; --i) out.push_back(value >> (8 * i));
+}
+
+void SmfWriter::header(int format, int num_tracks, int ticks_per_quarter) {
+  std::vector<uint8_t> body;
+  put_be(body, format, 2);
+  put_be(body, num_tracks, 2);
+  put_be(body, ticks_per_quarter, 2);
+  chunk("MThd", body);
+}
+
+void SmfWriter::begin_track() {
+  track.clear();
+  last_time = 0;
+  running_status = 0;
+}
+
+void SmfWriter::meta(int time, uint8_t type, const std::string &data) {
+  delta(time);
+  track.push_back(0xff);
+  track.push_back(type);
+  var_int(data.size());
+  track.insert(track.end(), data.begin(), data.end());
+  running_status = 0; // meta events cancel running status
+}
+
+void SmfWriter::channel_event(int time, uint8_t status, uint8_t data1) {
+  delta(time);
+  if (status != running_status) track.push_back(status);
+  track.push_back(data1 & 0x7f);
+  running_status = status;
+}
+
+void SmfWriter::channel_event(int time, uint8_t status, uint8_t data1,
+                              uint8_t data2) {
+  channel_event(time, status, data1);
+  track.push_back(data2 & 0x7f);
+}
+
+void SmfWriter::end_track() {
+  meta(last_time, 0x2f, "");
+  chunk("MTrk", track);
+  track.clear();
+}
+
+void SmfWriter::delta(int time) {
+  if (time < last_time)
+    throw std::logic_error("SMF events must be written in time order");
+  var_int(time - last_time);
+  last_time = time;
+}
+
+void SmfWriter::var_int(uint32_t value) {
+  uint8_t bytes[5];
+  int n = 0;
+  do {
+    bytes[n++] = value & 0x7f;
+    value >>= 7;
+  } while (value);
+  while (n > 1) track.push_back(bytes[--n] | 0x80);
+  track.push_back(bytes[0]);
+}
+
+void SmfWriter::chunk(const char *type, const std::vector<uint8_t> &body) {
+  std::vector<uint8_t> head(type, type + 4);
+  put_be(head, body.size(), 4);
+  ok = ok && sink.write(head.data(), head.size());
+  ok = ok && sink.write(body.data(), body.size());
+}
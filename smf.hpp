@@ -0,0 +1,77 @@
+#ifndef SMF_HPP
+#define SMF_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Where an SMF writer sends its bytes.
+class SmfSink {
+public:
+  virtual ~SmfSink() {}
+  virtual bool write(const void *data, size_t size) = 0;
+};
+
+class FileSink : public SmfSink {
+public:
+  explicit FileSink(FILE *file) : file(file) {}
+  bool write(const void *data, size_t size) override;
+
+private:
+  FILE *file;
+};
+
+#ifndef _WIN32
+class FdSink : public SmfSink {
+public:
+  explicit FdSink(int fd) : fd(fd) {}
+  bool write(const void *data, size_t size) override;
+
+private:
+  int fd;
+};
+#endif
+
+class MemorySink : public SmfSink {
+public:
+  explicit MemorySink(std::vector<uint8_t> &buffer) : buffer(buffer) {}
+  bool write(const void *data, size_t size) override;
+
+private:
+  std::vector<uint8_t> &buffer;
+};
+
+// Writes a Standard MIDI File straight to a sink, without building a MidiFile.
+// Events have to be given in time order within each track. Only the track
+// being written is kept in memory, so the chunk length can be filled in before
+// it's sent off. Channel messages use running status.
+class SmfWriter {
+public:
+  explicit SmfWriter(SmfSink &sink) : sink(sink), ok(true) {}
+
+  void header(int format, int num_tracks, int ticks_per_quarter);
+
+  void begin_track();
+  void meta(int time, uint8_t type, const std::string &data);
+  void channel_event(int time, uint8_t status, uint8_t data1);
+  void channel_event(int time, uint8_t status, uint8_t data1, uint8_t data2);
+  // Adds the end of track event and sends the chunk to the sink.
+  void end_track();
+
+  // Whether every write to the sink so far succeeded.
+  bool good() const { return ok; }
+
+private:
+  void delta(int time);
+  void var_int(uint32_t value);
+  void chunk(const char *type, const std::vector<uint8_t> &body);
+
+  SmfSink &sink;
+  bool ok;
+  std::vector<uint8_t> track;
+  int last_time;
+  uint8_t running_status;
+};
+
+#endif // SMF_HPP
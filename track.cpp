@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <queue>
+#include <tuple>
+
+#include "pitch_bend.hpp"
+#include "track.hpp"
+
+namespace {
+struct TrackBuilder {
+  TrackBuffer &track;
+
+  void controller(int time, int channel, int number, int value) {
+    track.events.push_back(
+        {time, TrackEvent::CONTROLLER, channel, number, value, 0});
+  }
+  void patch_change(int time, int channel, int program) {
+    track.events.push_back(
+        {time, TrackEvent::PATCH_CHANGE, channel, program, 0, 0});
+  }
+  void note_on(int time, int channel, int key, int vel) {
+    track.events.push_back({time, TrackEvent::NOTE_ON, channel, key, vel, 0});
+  }
+  void note_off(int time, int channel, int key) {
+    track.events.push_back({time, TrackEvent::NOTE_OFF, channel, key, 0, 0});
+  }
+  void pitch_bend(int time, int channel, double amount) {
+    track.events.push_back(
+        {time, TrackEvent::PITCH_BEND, channel, 0, 0, amount});
+  }
+};
+
+const int NO_MORE_EVENTS = INT_MAX;
+
+// The events of one kind, read off a time map in order. Each entry is turned
+// into MIDI events by `emit`.
+template <typename T, typename Emit> struct EventStream {
+  EventStream(const TimeMap<T> &map, Emit emit)
+      : it(map.begin()), end(map.end()), emit(emit) {}
+
+  int time() const { return it == end ? NO_MORE_EVENTS : it->first; }
+  void emit_at(int time) {
+    for (; it != end && it->first == time; ++it) emit(it->first, it->second);
+  }
+
+  typename TimeMap<T>::const_iterator it, end;
+  Emit emit;
+};
+
+template <typename T, typename Emit>
+EventStream<T, Emit> event_stream(const TimeMap<T> &map, Emit emit) {
+  return EventStream<T, Emit>(map, emit);
+}
+
+// The points of a pitch curve, generated as they're read.
+template <typename Emit> struct PitchStream {
+  PitchStream(PitchCurve &curve, Emit emit)
+      : curve(curve), has_point(curve.next(point)), emit(emit) {}
+
+  int time() const { return has_point ? point.time : NO_MORE_EVENTS; }
+  void emit_at(int time) {
+    for (; has_point && point.time == time; has_point = curve.next(point))
+      emit(point.time, point.offset);
+  }
+
+  PitchCurve &curve;
+  PitchPoint point;
+  bool has_point;
+  Emit emit;
+};
+
+template <typename Emit>
+PitchStream<Emit> pitch_stream(PitchCurve &curve, Emit emit) {
+  return PitchStream<Emit>(curve, emit);
+}
+
+// Note offs waiting for their time. Presses can overlap, so ends don't come in
+// press order; ties go to the earlier press.
+struct PendingNoteOffs {
+  struct NoteOff {
+    int time, order, channel, key;
+    bool operator>(const NoteOff &o) const {
+      return std::tie(time, order) > std::tie(o.time, o.order);
+    }
+  };
+
+  void add(int time, int channel, int key) {
+    queue.push({time, added++, channel, key});
+  }
+  int time() const { return queue.empty() ? NO_MORE_EVENTS : queue.top().time; }
+  void emit_at(int time, TrackBuilder &out) {
+    for (; !queue.empty() && queue.top().time == time; queue.pop())
+      out.note_off(time, queue.top().channel, queue.top().key);
+  }
+
+  std::priority_queue<NoteOff, std::vector<NoteOff>, std::greater<NoteOff>>
+      queue;
+  int added = 0;
+};
+} // namespace
+
+TrackBuffer unit_track(const Unit &unit, const std::string &name, int channel,
+                       const std::vector<Woice> &woices,
+                       double bend_tolerance) {
+  TrackBuffer track;
+  track.name = name;
+  TrackBuilder out{track};
+
+  // Every kind of event comes from its own time-ordered stream, and the
+  // streams are merged so the track comes out in time order without sorting.
+
+  // All these pxtone parameters go from 0 to *128*, so we need to cap at 127
+  auto volumes = event_stream(unit.volume, [&](int time, int volume) {
+    out.controller(time, channel, 11, std::min<int>(volume, 127));
+  });
+  auto pans = event_stream(unit.pan_v, [&](int time, int pan_v) {
+    out.controller(time, channel, 10, std::min<int>(pan_v, 127));
+  });
+  // note to self: when doing pan_t, also cap at 127
+
+  auto patches = event_stream(unit.voice, [&](int time, int voice) {
+    const Woice &woice = woices[voice];
+    if (!woice.drum) out.patch_change(time, channel, woice.num);
+  });
+
+  PitchCurve pitch(unit, bend_tolerance / 100);
+  auto bends = pitch_stream(pitch, [&](int time, double offset) {
+    int pitch_bend_range = int((std::floor(std::abs(offset) / 4) + 1) * 4);
+    double abs_offset = offset / pitch_bend_range;
+    out.controller(time, channel, 6, pitch_bend_range);
+    out.pitch_bend(time, channel, abs_offset);
+  });
+
+  PendingNoteOffs note_offs;
+  auto voice_at = unit.voice.cursor();
+  auto note_at = unit.notes.cursor();
+  auto note_ons = event_stream(unit.presses, [&](int time, const Press &press) {
+    const Woice &woice = woices[voice_at.at_time(time)];
+    int real_channel = (woice.drum ? 9 : channel);
+    int key = (woice.drum ? woice.num : note_at.at_time(time));
+    out.note_on(time, real_channel, key, std::min<int>(press.vel, 127));
+    note_offs.add(time + press.length, real_channel, key);
+  });
+
+  // mark cc6 as setting pitch bend range using cc100 and cc101
+  out.controller(0, channel, 100, 0);
+  out.controller(0, channel, 101, 0);
+
+  // Within a tick: controllers, then program changes, then note offs, then
+  // the pitch (which may be for the note that starts), then note ons. A zero
+  // length press's note off comes around again in the same tick.
+  for (;;) {
+    int time = std::min({volumes.time(), pans.time(), patches.time(),
+                         note_offs.time(), bends.time(), note_ons.time()});
+    if (time == NO_MORE_EVENTS) break;
+    volumes.emit_at(time);
+    pans.emit_at(time);
+    patches.emit_at(time);
+    note_offs.emit_at(time, out);
+    bends.emit_at(time);
+    note_ons.emit_at(time);
+  }
+  track.bend_points_removed = pitch.removed();
+
+  return track;
+}
+
+namespace {
+// What a receiver knows about a channel from the events kept so far. -1 is a
+// value that hasn't been set yet.
+struct ChannelState {
+  ChannelState() {
+    std::fill(std::begin(controllers), std::end(controllers), -1);
+  }
+
+  int controllers[128];
+  int program = -1;
+  int bend = -1;
+
+  // Updates the state with an event, returning false if it changed nothing.
+  bool apply(const TrackEvent &e) {
+    switch (e.type) {
+    case TrackEvent::CONTROLLER: {
+      int &value = controllers[e.data1];
+      if (value == e.data2) return false;
+      value = e.data2;
+      // data entry now goes to a different parameter
+      if (e.data1 == 100 || e.data1 == 101) controllers[6] = -1;
+      // the held bend means something else with a new range
+      if (e.data1 == 6) bend = -1;
+      return true;
+    }
+    case TrackEvent::PATCH_CHANGE:
+      if (program == e.data1) return false;
+      program = e.data1;
+      return true;
+    case TrackEvent::PITCH_BEND: {
+      int value = pitch_bend_value(e.bend);
+      if (bend == value) return false;
+      bend = value;
+      return true;
+    }
+    case TrackEvent::NOTE_ON:
+    case TrackEvent::NOTE_OFF:
+      return true;
+    }
+    return true;
+  }
+};
+} // namespace
+
+int drop_redundant_events(TrackBuffer &track) {
+  ChannelState channels[16];
+  auto kept = track.events.begin();
+  for (const TrackEvent &e : track.events)
+    if (channels[e.channel & 0x0f].apply(e)) *kept++ = e;
+  int removed = track.events.end() - kept;
+  track.events.erase(kept, track.events.end());
+  return removed;
+}
+
+void add_track(MidiFile &midifile, int track, const TrackBuffer &events) {
+  midifile.addTrackName(track, 0, events.name);
+  for (const TrackEvent &e : events.events) {
+    switch (e.type) {
+    case TrackEvent::CONTROLLER:
+      midifile.addController(track, e.time, e.channel, e.data1, e.data2);
+      break;
+    case TrackEvent::PATCH_CHANGE:
+      midifile.addPatchChange(track, e.time, e.channel, e.data1);
+      break;
+    case TrackEvent::NOTE_ON:
+      midifile.addNoteOn(track, e.time, e.channel, e.data1, e.data2);
+      break;
+    case TrackEvent::NOTE_OFF:
+      midifile.addNoteOff(track, e.time, e.channel, e.data1);
+      break;
+    case TrackEvent::PITCH_BEND:
+      midifile.addPitchBend(track, e.time, e.channel, e.bend);
+      break;
+    }
+  }
+}
+
+void write_track(SmfWriter &smf, const TrackBuffer &events) {
+  smf.begin_track();
+  smf.meta(0, 0x03, events.name);
+  for (const TrackEvent &e : events.events) {
+    int channel = e.channel & 0x0f;
+    switch (e.type) {
+    case TrackEvent::CONTROLLER:
+      smf.channel_event(e.time, 0xb0 | channel, e.data1, e.data2);
+      break;
+    case TrackEvent::PATCH_CHANGE:
+      smf.channel_event(e.time, 0xc0 | channel, e.data1);
+      break;
+    case TrackEvent::NOTE_ON:
+      smf.channel_event(e.time, 0x90 | channel, e.data1, e.data2);
+      break;
+    case TrackEvent::NOTE_OFF:
+      // as a zero velocity note on, so that it can share running status
+      smf.channel_event(e.time, 0x90 | channel, e.data1, 0);
+      break;
+    case TrackEvent::PITCH_BEND: {
+      int value = pitch_bend_value(e.bend);
+      smf.channel_event(e.time, 0xe0 | channel, value & 0x7f, value >> 7);
+      break;
+    }
+    }
+  }
+  smf.end_track();
+}
+
+int pitch_bend_value(double amount) {
+  int value = int((amount + 1) / 2 * 16384 + 0.5);
+  return std::max(0, std::min(value, 16383));
+}
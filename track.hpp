@@ -0,0 +1,53 @@
+#ifndef TRACK_HPP
+#define TRACK_HPP
+
+#include <string>
+#include <vector>
+
+#include "MidiFile.h"
+#include "pttypes.hpp"
+#include "smf.hpp"
+
+// A channel event buffered outside of a MidiFile, so that tracks can be built
+// independently (and in parallel) and only merged into a file at the end.
+struct TrackEvent {
+  enum Type { CONTROLLER, PATCH_CHANGE, NOTE_ON, NOTE_OFF, PITCH_BEND };
+
+  int time;
+  Type type;
+  int channel;
+  int data1, data2; // controller number/value, program, key/velocity
+  double bend;      // pitch bend amount, from -1 to 1
+};
+
+struct TrackBuffer {
+  std::string name;
+  std::vector<TrackEvent> events;
+  int bend_points_removed = 0; // by pitch curve simplification
+  int events_dropped = 0;      // by drop_redundant_events
+};
+
+// Builds the track for one unit, playing on the given (non-drum) channel. The
+// events come out in time order.
+// Pitch curves are simplified as long as they stay within `bend_tolerance`
+// cents of the exact curve (0 keeps every point).
+TrackBuffer unit_track(const Unit &unit, const std::string &name, int channel,
+                       const std::vector<Woice> &woices, double bend_tolerance);
+
+// Drops events that don't change the state of their channel: controllers and
+// programs set to the value they already have, repeated pitch bends, and the
+// bend range sent again with every bend. Events must be in time order. Returns
+// how many were dropped.
+int drop_redundant_events(TrackBuffer &track);
+
+// Appends a buffered track's events to the given track of a MidiFile.
+void add_track(MidiFile &midifile, int track, const TrackBuffer &events);
+
+// Writes a buffered track, whose events must be in time order, as one SMF
+// track chunk.
+void write_track(SmfWriter &smf, const TrackBuffer &events);
+
+// The 14-bit value of a pitch bend amount from -1 to 1.
+int pitch_bend_value(double amount);
+
+#endif // TRACK_HPP